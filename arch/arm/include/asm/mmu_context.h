@@ -149,8 +149,8 @@ do { \
 			high_vma->vm_prev->vm_next = NULL; \
 		else \
 			mm->mmap = NULL; \
+		vmacache_invalidate(mm); \
 		rb_erase(&high_vma->vm_rb, &mm->mm_rb); \
-		mm->mmap_cache = NULL; \
 		mm->map_count--; \
 		remove_vma(high_vma); \
 	} \
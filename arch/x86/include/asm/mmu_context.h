@@ -55,7 +55,14 @@ static inline void switch_mm(struct mm_struct *prev, struct mm_struct *next,
 	}
 #ifdef CONFIG_SMP
 	else {
-		percpu_write(cpu_tlbstate.state, TLBSTATE_OK);
+		int state;
+
+		/*
+		 * Pairs with the cmpxchg in flush_tlb_others_ipi(): either
+		 * the flusher saw us lazy and we see TLBSTATE_LAZY_FLUSH
+		 * here, or it sees TLBSTATE_OK and sends the IPI.
+		 */
+		state = xchg(&__get_cpu_var(cpu_tlbstate).state, TLBSTATE_OK);
 		BUG_ON(percpu_read(cpu_tlbstate.active_mm) != next);
 
 		if (!cpumask_test_and_set_cpu(cpu, mm_cpumask(next))) {
@@ -65,6 +72,9 @@ static inline void switch_mm(struct mm_struct *prev, struct mm_struct *next,
 			 */
 			load_cr3(next->pgd);
 			load_LDT_nolock(&next->context);
+		} else if (unlikely(state == TLBSTATE_LAZY_FLUSH)) {
+			/* a range flush skipped us while we were lazy */
+			local_flush_tlb();
 		}
 	}
 #endif
@@ -4,7 +4,19 @@
 #define tlb_start_vma(tlb, vma) do { } while (0)
 #define tlb_end_vma(tlb, vma) do { } while (0)
 #define __tlb_remove_tlb_entry(tlb, ptep, address) do { } while (0)
-#define tlb_flush(tlb) flush_tlb_mm((tlb)->mm)
+
+/*
+ * Flush only the range of ptes that was unmapped, unless page tables
+ * were freed: those must be flushed from lazy cpus as well.
+ */
+#define tlb_flush(tlb)							\
+do {									\
+	if ((tlb)->fullmm || (tlb)->freed_tables ||			\
+	    (tlb)->start >= (tlb)->end)					\
+		flush_tlb_mm((tlb)->mm);				\
+	else								\
+		flush_tlb_mm_range((tlb)->mm, (tlb)->start, (tlb)->end); \
+} while (0)
 
 #include <asm-generic/tlb.h>
 
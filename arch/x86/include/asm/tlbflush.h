@@ -77,14 +77,22 @@ static inline void __flush_tlb_one(unsigned long addr)
  *  - flush_tlb_page(vma, vmaddr) flushes one page
  *  - flush_tlb_range(vma, start, end) flushes a range of pages
  *  - flush_tlb_kernel_range(start, end) flushes a range of kernel pages
- *  - flush_tlb_others(cpumask, mm, va) flushes TLBs on other cpus
+ *  - flush_tlb_mm_range(mm, start, end) flushes a range of user pages
+ *  - flush_tlb_others(cpumask, mm, start, end) flushes TLBs on other cpus
  *
  * ..but the i386 has somewhat limited tlb flushing capabilities,
  * and page-granular flushes are available only on i486 and up.
  *
- * x86-64 can only flush individual pages or full VMs. For a range flush
- * we always do the full VM. Might be worth trying if for a small
- * range a few INVLPGs in a row are a win.
+ * x86 can only flush individual pages or the whole TLB.  A range of up
+ * to tlb_single_page_flush_ceiling pages is flushed with one INVLPG per
+ * page, a larger one flushes everything.  end == TLB_FLUSH_ALL always
+ * flushes everything.
+ *
+ * A range flush only invalidates ptes, never page tables: cpus running
+ * a kernel thread in lazy tlb mode on the mm are not interrupted, they
+ * are marked TLBSTATE_LAZY_FLUSH and flush when they switch back to
+ * the mm.  Whoever frees page tables must use flush_tlb_mm(), which
+ * makes lazy cpus leave the mm at once.
  */
 
 #ifndef CONFIG_SMP
@@ -106,16 +114,23 @@ static inline void flush_tlb_page(struct vm_area_struct *vma,
 		__flush_tlb_one(addr);
 }
 
+static inline void flush_tlb_mm_range(struct mm_struct *mm,
+				      unsigned long start, unsigned long end)
+{
+	if (mm == current->active_mm)
+		__flush_tlb();
+}
+
 static inline void flush_tlb_range(struct vm_area_struct *vma,
 				   unsigned long start, unsigned long end)
 {
-	if (vma->vm_mm == current->active_mm)
-		__flush_tlb();
+	flush_tlb_mm_range(vma->vm_mm, start, end);
 }
 
 static inline void native_flush_tlb_others(const struct cpumask *cpumask,
 					   struct mm_struct *mm,
-					   unsigned long va)
+					   unsigned long start,
+					   unsigned long end)
 {
 }
 
@@ -133,20 +148,24 @@ extern void flush_tlb_all(void);
 extern void flush_tlb_current_task(void);
 extern void flush_tlb_mm(struct mm_struct *);
 extern void flush_tlb_page(struct vm_area_struct *, unsigned long);
+extern void flush_tlb_mm_range(struct mm_struct *mm,
+			       unsigned long start, unsigned long end);
 
 #define flush_tlb()	flush_tlb_current_task()
 
 static inline void flush_tlb_range(struct vm_area_struct *vma,
 				   unsigned long start, unsigned long end)
 {
-	flush_tlb_mm(vma->vm_mm);
+	flush_tlb_mm_range(vma->vm_mm, start, end);
 }
 
 void native_flush_tlb_others(const struct cpumask *cpumask,
-			     struct mm_struct *mm, unsigned long va);
+			     struct mm_struct *mm,
+			     unsigned long start, unsigned long end);
 
-#define TLBSTATE_OK	1
-#define TLBSTATE_LAZY	2
+#define TLBSTATE_OK		1
+#define TLBSTATE_LAZY		2
+#define TLBSTATE_LAZY_FLUSH	3	/* lazy, and skipped a range flush */
 
 struct tlb_state {
 	struct mm_struct *active_mm;
@@ -163,7 +182,8 @@ static inline void reset_lazy_tlbstate(void)
 #endif	/* SMP */
 
 #ifndef CONFIG_PARAVIRT
-#define flush_tlb_others(mask, mm, va)	native_flush_tlb_others(mask, mm, va)
+#define flush_tlb_others(mask, mm, start, end)	\
+	native_flush_tlb_others(mask, mm, start, end)
 #endif
 
 static inline void flush_tlb_kernel_range(unsigned long start,
@@ -34,6 +34,7 @@ EXPORT_SYMBOL(_copy_to_user);
 
 EXPORT_SYMBOL(copy_page);
 EXPORT_SYMBOL(clear_page);
+EXPORT_SYMBOL(clear_page_nocache);
 
 EXPORT_SYMBOL(csum_partial);
 
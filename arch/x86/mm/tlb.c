@@ -13,6 +13,9 @@
 #include <asm/apic.h>
 #include <asm/uv/uv.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/tlb.h>
+
 DEFINE_PER_CPU_SHARED_ALIGNED(struct tlb_state, cpu_tlbstate)
 			= { &init_mm, 0, };
 
@@ -41,7 +44,8 @@ DEFINE_PER_CPU_SHARED_ALIGNED(struct tlb_state, cpu_tlbstate)
 union smp_flush_state {
 	struct {
 		struct mm_struct *flush_mm;
-		unsigned long flush_va;
+		unsigned long flush_start;
+		unsigned long flush_end;
 		raw_spinlock_t tlbstate_lock;
 		DECLARE_BITMAP(flush_cpumask, NR_CPUS);
 	};
@@ -55,6 +59,25 @@ static union smp_flush_state flush_state[NUM_INVALIDATE_TLB_VECTORS];
 
 static DEFINE_PER_CPU_READ_MOSTLY(int, tlb_vector_offset);
 
+/*
+ * Beyond this many pages, one INVLPG per page costs more than refilling
+ * the TLB after flushing it entirely.
+ */
+static unsigned long tlb_single_page_flush_ceiling __read_mostly = 33;
+
+static void flush_tlb_local_range(unsigned long start, unsigned long end)
+{
+	unsigned long addr;
+
+	if (end == TLB_FLUSH_ALL || !cpu_has_invlpg ||
+	    (end - start) >> PAGE_SHIFT > tlb_single_page_flush_ceiling) {
+		local_flush_tlb();
+		return;
+	}
+	for (addr = start; addr < end; addr += PAGE_SIZE)
+		__flush_tlb_single(addr);
+}
+
 /*
  * We cannot call mmdrop() because we are in interrupt context,
  * instead update mm->cpu_vm_mask.
@@ -112,7 +135,8 @@ EXPORT_SYMBOL_GPL(leave_mm);
  * TLB flush IPI:
  *
  * 1) Flush the tlb entries if the cpu uses the mm that's being flushed.
- * 2) Leave the mm if we are in the lazy tlb mode.
+ * 2) Leave the mm if we are in the lazy tlb mode.  Range flushes do
+ *    not interrupt lazy cpus at all, see flush_tlb_skip_lazy().
  *
  * Interrupts are disabled.
  */
@@ -153,12 +177,9 @@ void smp_invalidate_interrupt(struct pt_regs *regs)
 		 */
 
 	if (f->flush_mm == percpu_read(cpu_tlbstate.active_mm)) {
-		if (percpu_read(cpu_tlbstate.state) == TLBSTATE_OK) {
-			if (f->flush_va == TLB_FLUSH_ALL)
-				local_flush_tlb();
-			else
-				__flush_tlb_one(f->flush_va);
-		} else
+		if (percpu_read(cpu_tlbstate.state) == TLBSTATE_OK)
+			flush_tlb_local_range(f->flush_start, f->flush_end);
+		else
 			leave_mm(cpu);
 	}
 out:
@@ -169,10 +190,44 @@ out:
 	inc_irq_stat(irq_tlb_count);
 }
 
+/*
+ * A cpu running a kernel thread in lazy tlb mode on the mm does not use
+ * the user part of its TLB until it switches back to the mm: instead of
+ * interrupting it, mark it TLBSTATE_LAZY_FLUSH and let switch_mm()
+ * flush.  Only for range flushes: those free no page tables, which the
+ * cpu could still walk speculatively meanwhile.
+ *
+ * Returns how many cpus were removed from @cpumask.
+ */
+static unsigned int flush_tlb_skip_lazy(struct cpumask *cpumask,
+					struct mm_struct *mm)
+{
+	unsigned int cpu, nr_lazy = 0;
+
+	/* the cleared ptes must be visible before we look at the state */
+	smp_mb();
+
+	for_each_cpu(cpu, cpumask) {
+		struct tlb_state *ts = &per_cpu(cpu_tlbstate, cpu);
+
+		if (ts->active_mm != mm)
+			continue;
+		if (ts->state == TLBSTATE_LAZY_FLUSH ||
+		    cmpxchg(&ts->state, TLBSTATE_LAZY,
+			    TLBSTATE_LAZY_FLUSH) == TLBSTATE_LAZY) {
+			cpumask_clear_cpu(cpu, cpumask);
+			nr_lazy++;
+		}
+	}
+	return nr_lazy;
+}
+
 static void flush_tlb_others_ipi(const struct cpumask *cpumask,
-				 struct mm_struct *mm, unsigned long va)
+				 struct mm_struct *mm,
+				 unsigned long start, unsigned long end)
 {
 	unsigned int sender;
+	unsigned int nr_lazy = 0;
 	union smp_flush_state *f;
 
 	/* Caller has disabled preemption */
@@ -187,38 +242,53 @@ static void flush_tlb_others_ipi(const struct cpumask *cpumask,
 	raw_spin_lock(&f->tlbstate_lock);
 
 	f->flush_mm = mm;
-	f->flush_va = va;
+	f->flush_start = start;
+	f->flush_end = end;
 	if (cpumask_andnot(to_cpumask(f->flush_cpumask), cpumask, cpumask_of(smp_processor_id()))) {
+		if (end != TLB_FLUSH_ALL)
+			nr_lazy = flush_tlb_skip_lazy(to_cpumask(f->flush_cpumask),
+						      mm);
+		trace_tlb_flush_ipi(mm, start, end,
+				    to_cpumask(f->flush_cpumask), nr_lazy);
 		/*
 		 * We have to send the IPI only to
 		 * CPUs affected.
 		 */
-		apic->send_IPI_mask(to_cpumask(f->flush_cpumask),
-			      INVALIDATE_TLB_VECTOR_START + sender);
+		if (!cpumask_empty(to_cpumask(f->flush_cpumask))) {
+			apic->send_IPI_mask(to_cpumask(f->flush_cpumask),
+				      INVALIDATE_TLB_VECTOR_START + sender);
 
-		while (!cpumask_empty(to_cpumask(f->flush_cpumask)))
-			cpu_relax();
+			while (!cpumask_empty(to_cpumask(f->flush_cpumask)))
+				cpu_relax();
+		}
 	}
 
 	f->flush_mm = NULL;
-	f->flush_va = 0;
+	f->flush_start = 0;
+	f->flush_end = 0;
 	raw_spin_unlock(&f->tlbstate_lock);
 }
 
 void native_flush_tlb_others(const struct cpumask *cpumask,
-			     struct mm_struct *mm, unsigned long va)
+			     struct mm_struct *mm,
+			     unsigned long start, unsigned long end)
 {
 	if (is_uv_system()) {
 		unsigned int cpu;
+		unsigned long va = TLB_FLUSH_ALL;
+
+		/* the BAU flushes either one page or everything */
+		if (end != TLB_FLUSH_ALL && end - start == PAGE_SIZE)
+			va = start;
 
 		cpu = get_cpu();
 		cpumask = uv_flush_tlb_others(cpumask, mm, va, cpu);
 		if (cpumask)
-			flush_tlb_others_ipi(cpumask, mm, va);
+			flush_tlb_others_ipi(cpumask, mm, start, end);
 		put_cpu();
 		return;
 	}
-	flush_tlb_others_ipi(cpumask, mm, va);
+	flush_tlb_others_ipi(cpumask, mm, start, end);
 }
 
 static void __cpuinit calculate_tlb_offset(void)
@@ -284,49 +354,47 @@ void flush_tlb_current_task(void)
 
 	local_flush_tlb();
 	if (cpumask_any_but(mm_cpumask(mm), smp_processor_id()) < nr_cpu_ids)
-		flush_tlb_others(mm_cpumask(mm), mm, TLB_FLUSH_ALL);
+		flush_tlb_others(mm_cpumask(mm), mm, 0UL, TLB_FLUSH_ALL);
 	preempt_enable();
 }
 
-void flush_tlb_mm(struct mm_struct *mm)
+/*
+ * Flush the user pages in [start, end) of @mm on every cpu using it,
+ * with a single IPI per cpu.  end == TLB_FLUSH_ALL flushes the whole mm.
+ */
+void flush_tlb_mm_range(struct mm_struct *mm,
+			unsigned long start, unsigned long end)
 {
 	preempt_disable();
 
 	if (current->active_mm == mm) {
 		if (current->mm)
-			local_flush_tlb();
+			flush_tlb_local_range(start, end);
 		else
 			leave_mm(smp_processor_id());
 	}
 	if (cpumask_any_but(mm_cpumask(mm), smp_processor_id()) < nr_cpu_ids)
-		flush_tlb_others(mm_cpumask(mm), mm, TLB_FLUSH_ALL);
+		flush_tlb_others(mm_cpumask(mm), mm, start, end);
 
 	preempt_enable();
 }
 
-void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
+void flush_tlb_mm(struct mm_struct *mm)
 {
-	struct mm_struct *mm = vma->vm_mm;
-
-	preempt_disable();
-
-	if (current->active_mm == mm) {
-		if (current->mm)
-			__flush_tlb_one(va);
-		else
-			leave_mm(smp_processor_id());
-	}
-
-	if (cpumask_any_but(mm_cpumask(mm), smp_processor_id()) < nr_cpu_ids)
-		flush_tlb_others(mm_cpumask(mm), mm, va);
+	flush_tlb_mm_range(mm, 0UL, TLB_FLUSH_ALL);
+}
 
-	preempt_enable();
+void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
+{
+	flush_tlb_mm_range(vma->vm_mm, va, va + PAGE_SIZE);
 }
 
 static void do_flush_tlb_all(void *info)
 {
+	int state = percpu_read(cpu_tlbstate.state);
+
 	__flush_tlb_all();
-	if (percpu_read(cpu_tlbstate.state) == TLBSTATE_LAZY)
+	if (state == TLBSTATE_LAZY || state == TLBSTATE_LAZY_FLUSH)
 		leave_mm(smp_processor_id());
 }
 
@@ -55,11 +55,18 @@ EXPORT_SYMBOL(I_BDEV);
 static void bdev_inode_switch_bdi(struct inode *inode,
 			struct backing_dev_info *dst)
 {
-	spin_lock(&inode_lock);
+	struct backing_dev_info *old = inode->i_data.backing_dev_info;
+
+	if (unlikely(dst == old))		/* deadlock avoidance */
+		return;
+	bdi_lock_two(&old->wb, &dst->wb);
+	spin_lock(&inode->i_lock);
 	inode->i_data.backing_dev_info = dst;
 	if (inode->i_state & I_DIRTY)
 		list_move(&inode->i_wb_list, &dst->wb.b_dirty);
-	spin_unlock(&inode_lock);
+	spin_unlock(&inode->i_lock);
+	spin_unlock(&old->wb.list_lock);
+	spin_unlock(&dst->wb.list_lock);
 }
 
 static sector_t max_block(struct block_device *bdev)
@@ -342,33 +349,15 @@ static int blkdev_write_end(struct file *file, struct address_space *mapping,
 /*
  * private llseek:
  * for a block special file file->f_path.dentry->d_inode->i_size is zero
- * so we compute the size by hand (just as in block_read/write above)
+ * so we use the size of the bdev inode (just as in block_read/write above),
+ * which also bounds the offset.
  */
 static loff_t block_llseek(struct file *file, loff_t offset, int origin)
 {
 	struct inode *bd_inode = file->f_mapping->host;
-	loff_t size;
-	loff_t retval;
 
-	mutex_lock(&bd_inode->i_mutex);
-	size = i_size_read(bd_inode);
-
-	switch (origin) {
-		case 2:
-			offset += size;
-			break;
-		case 1:
-			offset += file->f_pos;
-	}
-	retval = -EINVAL;
-	if (offset >= 0 && offset <= size) {
-		if (offset != file->f_pos) {
-			file->f_pos = offset;
-		}
-		retval = offset;
-	}
-	mutex_unlock(&bd_inode->i_mutex);
-	return retval;
+	return generic_file_llseek_size(file, offset, origin,
+					i_size_read(bd_inode));
 }
 	
 int blkdev_fsync(struct file *filp, int datasync)
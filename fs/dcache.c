@@ -116,7 +116,9 @@ static void dentry_iput(struct dentry * dentry)
 {
 	struct inode *inode = dentry->d_inode;
 	if (inode) {
+		write_seqcount_begin(&dentry->d_seq);
 		dentry->d_inode = NULL;
+		write_seqcount_end(&dentry->d_seq);
 		list_del_init(&dentry->d_alias);
 		spin_unlock(&dentry->d_lock);
 		spin_unlock(&dcache_lock);
@@ -133,35 +135,57 @@ static void dentry_iput(struct dentry * dentry)
 }
 
 /*
- * dentry_lru_(add|del|move_tail) must be called with dcache_lock held.
+ * dentry_lru_(add|del|move_tail) take the per-superblock s_dentry_lru_lock,
+ * which nests inside dentry->d_lock.  dentry_lru_add must be called with
+ * d_lock held so that the dentry cannot be killed underneath us.
  */
 static void dentry_lru_add(struct dentry *dentry)
 {
+	struct super_block *sb = dentry->d_sb;
+
 	if (list_empty(&dentry->d_lru)) {
-		list_add(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-		dentry->d_sb->s_nr_dentry_unused++;
-		percpu_counter_inc(&nr_dentry_unused);
+		spin_lock(&sb->s_dentry_lru_lock);
+		if (list_empty(&dentry->d_lru)) {
+			list_add(&dentry->d_lru, &sb->s_dentry_lru);
+			sb->s_nr_dentry_unused++;
+			percpu_counter_inc(&nr_dentry_unused);
+		}
+		spin_unlock(&sb->s_dentry_lru_lock);
 	}
 }
 
+static void __dentry_lru_del(struct dentry *dentry)
+{
+	list_del_init(&dentry->d_lru);
+	dentry->d_sb->s_nr_dentry_unused--;
+	percpu_counter_dec(&nr_dentry_unused);
+}
+
 static void dentry_lru_del(struct dentry *dentry)
 {
+	struct super_block *sb = dentry->d_sb;
+
 	if (!list_empty(&dentry->d_lru)) {
-		list_del_init(&dentry->d_lru);
-		dentry->d_sb->s_nr_dentry_unused--;
-		percpu_counter_dec(&nr_dentry_unused);
+		spin_lock(&sb->s_dentry_lru_lock);
+		if (!list_empty(&dentry->d_lru))
+			__dentry_lru_del(dentry);
+		spin_unlock(&sb->s_dentry_lru_lock);
 	}
 }
 
 static void dentry_lru_move_tail(struct dentry *dentry)
 {
+	struct super_block *sb = dentry->d_sb;
+
+	spin_lock(&sb->s_dentry_lru_lock);
 	if (list_empty(&dentry->d_lru)) {
-		list_add_tail(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-		dentry->d_sb->s_nr_dentry_unused++;
+		list_add_tail(&dentry->d_lru, &sb->s_dentry_lru);
+		sb->s_nr_dentry_unused++;
 		percpu_counter_inc(&nr_dentry_unused);
 	} else {
-		list_move_tail(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
+		list_move_tail(&dentry->d_lru, &sb->s_dentry_lru);
 	}
+	spin_unlock(&sb->s_dentry_lru_lock);
 }
 
 /**
@@ -226,10 +250,35 @@ void dput(struct dentry *dentry)
 repeat:
 	if (atomic_read(&dentry->d_count) == 1)
 		might_sleep();
-	if (!atomic_dec_and_lock(&dentry->d_count, &dcache_lock))
+	if (d_unhashed(dentry) || (dentry->d_op && dentry->d_op->d_delete))
+		goto slow;
+	if (!atomic_dec_and_lock(&dentry->d_count, &dentry->d_lock))
 		return;
 
+	/*
+	 * The common case is a hashed dentry that simply stays cached: it
+	 * only needs to go on the LRU, which d_lock is enough for.
+	 */
+	if (!d_unhashed(dentry)) {
+		dentry->d_flags |= DCACHE_REFERENCED;
+		dentry_lru_add(dentry);
+		spin_unlock(&dentry->d_lock);
+		return;
+	}
+
+	/*
+	 * It was unhashed under us.  Killing it needs dcache_lock, which
+	 * nests outside d_lock: put our reference back while d_lock still
+	 * keeps the dentry alive and drop it again the old way.
+	 */
+	atomic_inc(&dentry->d_count);
+	spin_unlock(&dentry->d_lock);
+slow:
+	if (!atomic_dec_and_lock(&dentry->d_count, &dcache_lock))
+		return;
 	spin_lock(&dentry->d_lock);
+
+	/* __d_lookup() may have revived it before we got d_lock */
 	if (atomic_read(&dentry->d_count)) {
 		spin_unlock(&dentry->d_lock);
 		spin_unlock(&dcache_lock);
@@ -460,7 +509,15 @@ static void shrink_dentry_list(struct list_head *list)
 	struct dentry *dentry;
 
 	while (!list_empty(list)) {
+		/*
+		 * The private list is only ever modified with dcache_lock
+		 * held, so we can peek at it without s_dentry_lru_lock.
+		 * Take d_lock before unlinking so that a racing dput()
+		 * cannot put the dentry back on the LRU once we decide to
+		 * kill it.
+		 */
 		dentry = list_entry(list->prev, struct dentry, d_lru);
+		spin_lock(&dentry->d_lock);
 		dentry_lru_del(dentry);
 
 		/*
@@ -468,7 +525,6 @@ static void shrink_dentry_list(struct list_head *list)
 		 * the LRU because of laziness during lookup.  Do not free
 		 * it - just keep it off the LRU list.
 		 */
-		spin_lock(&dentry->d_lock);
 		if (atomic_read(&dentry->d_count)) {
 			spin_unlock(&dentry->d_lock);
 			continue;
@@ -496,39 +552,52 @@ static void __shrink_dcache_sb(struct super_block *sb, int *count, int flags)
 	int cnt = *count;
 
 	spin_lock(&dcache_lock);
+relock:
+	spin_lock(&sb->s_dentry_lru_lock);
 	while (!list_empty(&sb->s_dentry_lru)) {
 		dentry = list_entry(sb->s_dentry_lru.prev,
 				struct dentry, d_lru);
 		BUG_ON(dentry->d_sb != sb);
 
+		/* d_lock nests outside s_dentry_lru_lock */
+		if (!spin_trylock(&dentry->d_lock)) {
+			spin_unlock(&sb->s_dentry_lru_lock);
+			cpu_relax();
+			goto relock;
+		}
+
 		/*
 		 * If we are honouring the DCACHE_REFERENCED flag and the
 		 * dentry has this flag set, don't free it.  Clear the flag
 		 * and put it back on the LRU.
 		 */
-		if (flags & DCACHE_REFERENCED) {
-			spin_lock(&dentry->d_lock);
-			if (dentry->d_flags & DCACHE_REFERENCED) {
-				dentry->d_flags &= ~DCACHE_REFERENCED;
-				list_move(&dentry->d_lru, &referenced);
-				spin_unlock(&dentry->d_lock);
-				cond_resched_lock(&dcache_lock);
-				continue;
-			}
+		if ((flags & DCACHE_REFERENCED) &&
+		    (dentry->d_flags & DCACHE_REFERENCED)) {
+			dentry->d_flags &= ~DCACHE_REFERENCED;
+			list_move(&dentry->d_lru, &referenced);
+			spin_unlock(&dentry->d_lock);
+		} else {
+			list_move_tail(&dentry->d_lru, &tmp);
 			spin_unlock(&dentry->d_lock);
+			if (!--cnt)
+				break;
+		}
+		if (need_resched() || spin_needbreak(&dcache_lock)) {
+			spin_unlock(&sb->s_dentry_lru_lock);
+			cond_resched_lock(&dcache_lock);
+			goto relock;
 		}
-
-		list_move_tail(&dentry->d_lru, &tmp);
-		if (!--cnt)
-			break;
-		cond_resched_lock(&dcache_lock);
 	}
+	spin_unlock(&sb->s_dentry_lru_lock);
 
 	*count = cnt;
 	shrink_dentry_list(&tmp);
 
-	if (!list_empty(&referenced))
+	if (!list_empty(&referenced)) {
+		spin_lock(&sb->s_dentry_lru_lock);
 		list_splice(&referenced, &sb->s_dentry_lru);
+		spin_unlock(&sb->s_dentry_lru_lock);
+	}
 	spin_unlock(&dcache_lock);
 
 }
@@ -624,10 +693,14 @@ void shrink_dcache_sb(struct super_block *sb)
 	LIST_HEAD(tmp);
 
 	spin_lock(&dcache_lock);
+	spin_lock(&sb->s_dentry_lru_lock);
 	while (!list_empty(&sb->s_dentry_lru)) {
 		list_splice_init(&sb->s_dentry_lru, &tmp);
+		spin_unlock(&sb->s_dentry_lru_lock);
 		shrink_dentry_list(&tmp);
+		spin_lock(&sb->s_dentry_lru_lock);
 	}
+	spin_unlock(&sb->s_dentry_lru_lock);
 	spin_unlock(&dcache_lock);
 }
 EXPORT_SYMBOL(shrink_dcache_sb);
@@ -839,14 +912,18 @@ resume:
 
 		/* 
 		 * move only zero ref count dentries to the end 
-		 * of the unused list for prune_dcache
+		 * of the unused list for prune_dcache.  d_lock keeps
+		 * a concurrent dput() from dropping the last reference
+		 * in between.
 		 */
+		spin_lock(&dentry->d_lock);
 		if (!atomic_read(&dentry->d_count)) {
 			dentry_lru_move_tail(dentry);
 			found++;
 		} else {
 			dentry_lru_del(dentry);
 		}
+		spin_unlock(&dentry->d_lock);
 
 		/*
 		 * We can return to the caller if we have found some (this
@@ -963,6 +1040,7 @@ struct dentry *d_alloc(struct dentry * parent, const struct qstr *name)
 	atomic_set(&dentry->d_count, 1);
 	dentry->d_flags = DCACHE_UNHASHED;
 	spin_lock_init(&dentry->d_lock);
+	seqcount_init(&dentry->d_seq);
 	dentry->d_inode = NULL;
 	dentry->d_parent = NULL;
 	dentry->d_sb = NULL;
@@ -1006,9 +1084,13 @@ EXPORT_SYMBOL(d_alloc_name);
 /* the caller must hold dcache_lock */
 static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 {
+	spin_lock(&dentry->d_lock);
 	if (inode)
 		list_add(&dentry->d_alias, &inode->i_dentry);
+	write_seqcount_begin(&dentry->d_seq);
 	dentry->d_inode = inode;
+	write_seqcount_end(&dentry->d_seq);
+	spin_unlock(&dentry->d_lock);
 	fsnotify_d_instantiate(dentry, inode);
 }
 
@@ -1456,6 +1538,60 @@ next:
  	return found;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without taking a reference
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ * @seq: returns the d_seq value of the dentry that was found
+ * Returns: dentry, or NULL
+ *
+ * __d_lookup_rcu is used by RCU path walking, which must not write to
+ * any shared cache line.  The name comparison is done without d_lock,
+ * so the result is only stable if the caller later finds that
+ * read_seqcount_retry(&dentry->d_seq, *seq) has not changed.  Like
+ * __d_lookup it may return a false negative due to a concurrent rename.
+ *
+ * The parent must not have ->d_hash or ->d_compare operations.  The
+ * caller must hold rcu_read_lock().
+ */
+struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name,
+			      unsigned *seq)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_head *head = d_hash(parent, hash);
+	struct hlist_node *node;
+	struct dentry *dentry;
+
+	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+		const unsigned char *tname;
+		unsigned int tlen;
+		unsigned s;
+
+		if (dentry->d_name.hash != hash)
+			continue;
+seqretry:
+		s = read_seqcount_begin(&dentry->d_seq);
+		if (dentry->d_parent != parent)
+			continue;
+		if (d_unhashed(dentry))
+			continue;
+		tlen = dentry->d_name.len;
+		tname = dentry->d_name.name;
+		if (read_seqcount_retry(&dentry->d_seq, s)) {
+			cpu_relax();
+			goto seqretry;
+		}
+		/* a concurrent rename is caught by the caller's seq check */
+		if (tlen != len || memcmp(tname, str, len))
+			continue;
+		*seq = s;
+		return dentry;
+	}
+	return NULL;
+}
+
 /**
  * d_hash_and_lookup - hash the qstr then search for a dentry
  * @dir: Directory to search in
@@ -1682,6 +1818,8 @@ static void d_move_locked(struct dentry * dentry, struct dentry * target)
 		spin_lock_nested(&target->d_lock, DENTRY_D_LOCK_NESTED);
 	}
 
+	write_seqcount_begin(&dentry->d_seq);
+
 	/* Move the dentry to the target hash queue, if on different bucket */
 	if (d_unhashed(dentry))
 		goto already_unhashed;
@@ -1694,6 +1832,7 @@ already_unhashed:
 
 	/* Unhash the target: dput() will then get rid of it */
 	__d_drop(target);
+	write_seqcount_begin(&target->d_seq);
 
 	list_del(&dentry->d_u.d_child);
 	list_del(&target->d_u.d_child);
@@ -1715,6 +1854,8 @@ already_unhashed:
 	}
 
 	list_add(&dentry->d_u.d_child, &dentry->d_parent->d_subdirs);
+	write_seqcount_end(&target->d_seq);
+	write_seqcount_end(&dentry->d_seq);
 	spin_unlock(&target->d_lock);
 	fsnotify_d_move(dentry);
 	spin_unlock(&dentry->d_lock);
@@ -1865,7 +2006,9 @@ struct dentry *d_materialise_unique(struct dentry *dentry, struct inode *inode)
 			 * into our tree? */
 			if (IS_ROOT(alias)) {
 				spin_lock(&alias->d_lock);
+				write_seqcount_begin(&alias->d_seq);
 				__d_materialise_dentry(dentry, alias);
+				write_seqcount_end(&alias->d_seq);
 				__d_drop(alias);
 				goto found;
 			}
@@ -2484,6 +2627,7 @@ void __init vfs_caches_init(unsigned long mempages)
 			SLAB_HWCACHE_ALIGN|SLAB_PANIC, NULL);
 
 	dcache_init();
+	namei_init();
 	inode_init();
 	files_init(mempages);
 	mnt_init();
@@ -26,6 +26,7 @@
 #include <linux/file.h>
 #include <linux/fdtable.h>
 #include <linux/mm.h>
+#include <linux/vmacache.h>
 #include <linux/stat.h>
 #include <linux/fcntl.h>
 #include <linux/swap.h>
@@ -796,6 +797,8 @@ static int exec_mmap(struct mm_struct *mm)
 	tsk->mm = mm;
 	tsk->active_mm = mm;
 	activate_mm(active_mm, mm);
+	tsk->mm->vmacache_seqnum = 0;
+	vmacache_flush(tsk);
 	if (old_mm && tsk->signal->oom_score_adj == OOM_SCORE_ADJ_MIN) {
 		atomic_dec(&old_mm->oom_disable_count);
 		atomic_inc(&tsk->mm->oom_disable_count);
@@ -977,7 +980,8 @@ static void flush_old_files(struct files_struct * files)
 		set = fdt->close_on_exec->fds_bits[j];
 		if (!set)
 			continue;
-		fdt->close_on_exec->fds_bits[j] = 0;
+		/* alloc_fd() may be setting other bits without file_lock */
+		set = xchg(&fdt->close_on_exec->fds_bits[j], 0);
 		spin_unlock(&files->file_lock);
 		for ( ; set ; i++,set >>= 1) {
 			if (set & 1) {
@@ -1902,8 +1906,8 @@ static int umh_pipe_setup(struct subprocess_info *info)
 	fd_install(0, rp);
 	spin_lock(&cf->file_lock);
 	fdt = files_fdtable(cf);
-	FD_SET(0, fdt->open_fds);
-	FD_CLR(0, fdt->close_on_exec);
+	fdt_mark_open(fdt, 0);
+	fdt_set_cloexec(fdt, 0, 0);
 	spin_unlock(&cf->file_lock);
 
 	/* and disallow core files too */
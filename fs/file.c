@@ -118,7 +118,9 @@ void free_fdtable_rcu(struct rcu_head *rcu)
  */
 static void copy_fdtable(struct fdtable *nfdt, struct fdtable *ofdt)
 {
-	unsigned int cpy, set;
+	unsigned long *ofds = ofdt->open_fds->fds_bits;
+	unsigned long *nfds = nfdt->open_fds->fds_bits;
+	unsigned int cpy, set, i;
 
 	BUG_ON(nfdt->max_fds < ofdt->max_fds);
 
@@ -127,9 +129,16 @@ static void copy_fdtable(struct fdtable *nfdt, struct fdtable *ofdt)
 	memcpy(nfdt->fd, ofdt->fd, cpy);
 	memset((char *)(nfdt->fd) + cpy, 0, set);
 
+	/*
+	 * open_fds is moved rather than copied, leaving the old bitmap
+	 * full: a lockless alloc_fd() either won its bit before the
+	 * exchange, and the bit comes along, or finds no free slot.
+	 */
+	for (i = 0; i < ofdt->max_fds / BITS_PER_LONG; i++)
+		nfds[i] = xchg(&ofds[i], ~0UL);
+
 	cpy = ofdt->max_fds / BITS_PER_BYTE;
 	set = (nfdt->max_fds - ofdt->max_fds) / BITS_PER_BYTE;
-	memcpy(nfdt->open_fds, ofdt->open_fds, cpy);
 	memset((char *)(nfdt->open_fds) + cpy, 0, set);
 	memcpy(nfdt->close_on_exec, ofdt->close_on_exec, cpy);
 	memset((char *)(nfdt->close_on_exec) + cpy, 0, set);
@@ -194,25 +203,34 @@ out:
  * the given size.
  * Return <0 error code on error; 1 on successful completion.
  * The files->file_lock should be held on entry, and will be held on exit.
+ *
+ * files->resizing sends new lockless allocators in alloc_fd() to the
+ * locked path; those already in the old table are handled by
+ * copy_fdtable() and alloc_fd_lockless().
  */
 static int expand_fdtable(struct files_struct *files, int nr)
 	__releases(files->file_lock)
 	__acquires(files->file_lock)
 {
 	struct fdtable *new_fdt, *cur_fdt;
+	int ret = 1;
 
+	files->resizing++;
 	spin_unlock(&files->file_lock);
 	new_fdt = alloc_fdtable(nr);
 	spin_lock(&files->file_lock);
-	if (!new_fdt)
-		return -ENOMEM;
+	if (!new_fdt) {
+		ret = -ENOMEM;
+		goto out;
+	}
 	/*
 	 * extremely unlikely race - sysctl_nr_open decreased between the check in
 	 * caller and alloc_fdtable().  Cheaper to catch it here...
 	 */
 	if (unlikely(new_fdt->max_fds <= nr)) {
 		__free_fdtable(new_fdt);
-		return -EMFILE;
+		ret = -EMFILE;
+		goto out;
 	}
 	/*
 	 * Check again since another task may have expanded the fd table while
@@ -222,6 +240,8 @@ static int expand_fdtable(struct files_struct *files, int nr)
 	if (nr >= cur_fdt->max_fds) {
 		/* Continue as planned */
 		copy_fdtable(new_fdt, cur_fdt);
+		/* pairs with the barrier in alloc_fd_lockless() */
+		smp_mb();
 		rcu_assign_pointer(files->fdt, new_fdt);
 		if (cur_fdt->max_fds > NR_OPEN_DEFAULT)
 			free_fdtable(cur_fdt);
@@ -229,7 +249,11 @@ static int expand_fdtable(struct files_struct *files, int nr)
 		/* Somebody else expanded, so undo our attempt */
 		__free_fdtable(new_fdt);
 	}
-	return 1;
+out:
+	/* publish the new table before letting lockless allocators back */
+	smp_wmb();
+	files->resizing--;
+	return ret;
 }
 
 /*
@@ -300,6 +324,7 @@ struct files_struct *dup_fd(struct files_struct *oldf, int *errorp)
 
 	spin_lock_init(&newf->file_lock);
 	newf->next_fd = 0;
+	newf->resizing = 0;
 	new_fdt = &newf->fdtab;
 	new_fdt->max_fds = NR_OPEN_DEFAULT;
 	new_fdt->close_on_exec = (fd_set *)&newf->close_on_exec_init;
@@ -421,6 +446,63 @@ struct files_struct init_files = {
 	.file_lock	= __SPIN_LOCK_UNLOCKED(init_task.file_lock),
 };
 
+/*
+ * Claim a descriptor without file_lock: find a zero bit at or above the
+ * hint and take it with test_and_set_bit(), rescanning if another thread
+ * got there first.  Returns -EAGAIN when the table is being resized or
+ * has no free slot below the limit; the locked path then takes over.
+ *
+ * next_fd is a lower bound on the free descriptors, which is what keeps
+ * open() returning the lowest one.  Here it is only advanced past the
+ * slot it pointed at, and only if we won that slot: any other free slot
+ * we skipped may have been freed behind our back.
+ *
+ * A bit won in a table that expand_fdtable() is replacing is carried
+ * over by copy_fdtable(), but close_on_exec may have been copied before
+ * we set it.  If the table changed, set it again under the lock.
+ */
+static int alloc_fd_lockless(struct files_struct *files, unsigned start,
+			     unsigned flags)
+{
+	struct fdtable *fdt;
+	unsigned int fd, hint, max;
+	int error = -EAGAIN;
+
+	rcu_read_lock();
+	if (ACCESS_ONCE(files->resizing))
+		goto out;
+	smp_rmb();
+	fdt = files_fdtable(files);
+	max = min_t(unsigned long, fdt->max_fds, rlimit(RLIMIT_NOFILE));
+	hint = ACCESS_ONCE(files->next_fd);
+	fd = max(start, hint);
+	for (;;) {
+		if (fd >= max)
+			goto out;
+		fd = find_next_zero_bit(fdt->open_fds->fds_bits, max, fd);
+		if (fd >= max)
+			goto out;
+		if (!test_and_set_bit(fd, fdt->open_fds->fds_bits))
+			break;
+		fd++;
+	}
+	if (fd == hint)
+		cmpxchg(&files->next_fd, hint, fd + 1);
+
+	fdt_set_cloexec(fdt, fd, flags & O_CLOEXEC);
+	smp_mb();
+	if (unlikely(rcu_dereference_raw(files->fdt) != fdt ||
+		     ACCESS_ONCE(files->resizing))) {
+		spin_lock(&files->file_lock);
+		fdt_set_cloexec(files_fdtable(files), fd, flags & O_CLOEXEC);
+		spin_unlock(&files->file_lock);
+	}
+	error = fd;
+out:
+	rcu_read_unlock();
+	return error;
+}
+
 /*
  * allocate a file descriptor, mark it busy.
  */
@@ -431,6 +513,10 @@ int alloc_fd(unsigned start, unsigned flags)
 	int error;
 	struct fdtable *fdt;
 
+	error = alloc_fd_lockless(files, start, flags);
+	if (error != -EAGAIN)
+		return error;
+
 	spin_lock(&files->file_lock);
 repeat:
 	fdt = files_fdtable(files);
@@ -453,14 +539,14 @@ repeat:
 	if (error)
 		goto repeat;
 
+	/* lost a race with alloc_fd_lockless() */
+	if (test_and_set_bit(fd, fdt->open_fds->fds_bits))
+		goto repeat;
+
 	if (start <= files->next_fd)
 		files->next_fd = fd + 1;
 
-	FD_SET(fd, fdt->open_fds);
-	if (flags & O_CLOEXEC)
-		FD_SET(fd, fdt->close_on_exec);
-	else
-		FD_CLR(fd, fdt->close_on_exec);
+	fdt_set_cloexec(fdt, fd, flags & O_CLOEXEC);
 	error = fd;
 #if 1
 	/* Sanity check */
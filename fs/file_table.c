@@ -20,10 +20,10 @@
 #include <linux/cdev.h>
 #include <linux/fsnotify.h>
 #include <linux/sysctl.h>
-#include <linux/lglock.h>
 #include <linux/percpu_counter.h>
 #include <linux/percpu.h>
 #include <linux/ima.h>
+#include <linux/workqueue.h>
 
 #include <asm/atomic.h>
 
@@ -34,9 +34,6 @@ struct files_stat_struct files_stat = {
 	.max_files = NR_FILE
 };
 
-DECLARE_LGLOCK(files_lglock);
-DEFINE_LGLOCK(files_lglock);
-
 /* SLAB cache for file structures */
 static struct kmem_cache *filp_cachep __read_mostly;
 
@@ -128,7 +125,6 @@ struct file *get_empty_filp(void)
 	if (security_file_alloc(f))
 		goto fail_sec;
 
-	INIT_LIST_HEAD(&f->f_u.fu_list);
 	atomic_long_set(&f->f_count, 1);
 	rwlock_init(&f->f_owner.lock);
 	f->f_cred = get_cred(cred);
@@ -250,7 +246,6 @@ static void __fput(struct file *file)
 		cdev_put(inode->i_cdev);
 	fops_put(file->f_op);
 	put_pid(file->f_owner.pid);
-	file_sb_list_del(file);
 	if (file->f_mode & FMODE_WRITE)
 		drop_file_write_access(file);
 	file->f_path.dentry = NULL;
@@ -260,12 +255,171 @@ static void __fput(struct file *file)
 	mntput(mnt);
 }
 
-void fput(struct file *file)
+/*
+ * Deferred fput.  With fs.fput-defer-max set, the final fput() from a
+ * user task does not tear the file down inline: the file is queued on a
+ * per-cpu list and a per-cpu work item runs __fput() on the whole batch.
+ * A queue that reaches fput-defer-max is drained by the task that filled
+ * it, which bounds both the memory held and the delay before release.
+ *
+ * Only files whose late release nobody can observe are deferred; see
+ * fput_may_defer().
+ */
+struct fput_defer {
+	spinlock_t lock;
+	struct list_head list;
+	unsigned int nr;
+	struct work_struct wq;
+	unsigned long nr_deferred;	/* stats, under lock */
+	unsigned long nr_batches;
+	unsigned long max_batch;
+};
+
+static DEFINE_PER_CPU(struct fput_defer, fput_defer_list);
+
+int sysctl_fput_defer_max __read_mostly;
+
+static void fput_defer_take(struct fput_defer *fdef, struct list_head *batch)
+{
+	if (!fdef->nr)
+		return;
+	list_splice_init(&fdef->list, batch);
+	fdef->nr_batches++;
+	if (fdef->nr > fdef->max_batch)
+		fdef->max_batch = fdef->nr;
+	fdef->nr = 0;
+}
+
+static void fput_batch(struct list_head *batch)
 {
-	if (atomic_long_dec_and_test(&file->f_count))
+	struct file *file, *next;
+
+	/* __fput() reuses f_u for the RCU free */
+	list_for_each_entry_safe(file, next, batch, f_u.fu_list)
 		__fput(file);
 }
 
+static void fput_defer_work(struct work_struct *work)
+{
+	struct fput_defer *fdef = container_of(work, struct fput_defer, wq);
+	LIST_HEAD(batch);
+
+	spin_lock(&fdef->lock);
+	fput_defer_take(fdef, &batch);
+	spin_unlock(&fdef->lock);
+	fput_batch(&batch);
+}
+
+/*
+ * The last close of a file opened for writing must drop i_writecount
+ * before close() returns, or an exec of the file just written fails
+ * with ETXTBSY.  flock locks and leases must go away at close, and so
+ * must the last reference to a pipe, socket or device, whose peer or
+ * driver waits for it.  Watchers expect IN_CLOSE_NOWRITE at close, and
+ * the space of an unlinked file is expected back at its last close.
+ * What is left are read-only regular files and directories that hold
+ * no locks and nobody watches: releasing those late only delays the
+ * mntput, which umount flushes.
+ */
+static bool fput_may_defer(struct file *file)
+{
+	struct dentry *dentry = file->f_path.dentry;
+	struct inode *inode = dentry->d_inode;
+
+	if (file->f_mode & FMODE_WRITE)
+		return false;
+	if (!S_ISREG(inode->i_mode) && !S_ISDIR(inode->i_mode))
+		return false;
+	if (file->f_op && file->f_op->flush)
+		return false;
+	if (!inode->i_nlink)
+		return false;
+#ifdef CONFIG_FSNOTIFY
+	if (inode->i_fsnotify_mask ||
+	    (dentry->d_flags & DCACHE_FSNOTIFY_PARENT_WATCHED))
+		return false;
+#endif
+	/* flock locks of this file stay on the list until __fput() */
+	return ACCESS_ONCE(inode->i_flock) == NULL;
+}
+
+static void fput_defer(struct file *file)
+{
+	struct fput_defer *fdef;
+	LIST_HEAD(batch);
+
+	fdef = &get_cpu_var(fput_defer_list);
+	spin_lock(&fdef->lock);
+	list_add_tail(&file->f_u.fu_list, &fdef->list);
+	fdef->nr_deferred++;
+	if (++fdef->nr >= sysctl_fput_defer_max)
+		fput_defer_take(fdef, &batch);
+	else if (fdef->nr == 1)
+		schedule_work(&fdef->wq);
+	spin_unlock(&fdef->lock);
+	put_cpu_var(fput_defer_list);
+
+	fput_batch(&batch);
+}
+
+/**
+ * flush_deferred_fput - release all files queued by deferred fput
+ *
+ * Called before operations, like umount and remount read-only, that
+ * fail while a closed file still pins its mount.
+ */
+void flush_deferred_fput(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct fput_defer *fdef = &per_cpu(fput_defer_list, cpu);
+		LIST_HEAD(batch);
+
+		spin_lock(&fdef->lock);
+		fput_defer_take(fdef, &batch);
+		spin_unlock(&fdef->lock);
+		fput_batch(&batch);
+		/* wait for a batch the work item already took */
+		flush_work(&fdef->wq);
+	}
+}
+
+#if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
+int proc_fput_defer_state(ctl_table *table, int write,
+			  void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	struct fput_defer_stat_t stat = { 0, };
+	ctl_table t = *table;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct fput_defer *fdef = &per_cpu(fput_defer_list, cpu);
+
+		spin_lock(&fdef->lock);
+		stat.nr_queued += fdef->nr;
+		stat.nr_deferred += fdef->nr_deferred;
+		stat.nr_batches += fdef->nr_batches;
+		stat.max_batch = max(stat.max_batch, fdef->max_batch);
+		spin_unlock(&fdef->lock);
+	}
+	/* format a private copy: concurrent readers must not share one */
+	t.data = &stat;
+	return proc_doulongvec_minmax(&t, write, buffer, lenp, ppos);
+}
+#endif
+
+void fput(struct file *file)
+{
+	if (atomic_long_dec_and_test(&file->f_count)) {
+		if (sysctl_fput_defer_max && !(current->flags & PF_KTHREAD) &&
+		    fput_may_defer(file))
+			fput_defer(file);
+		else
+			__fput(file);
+	}
+}
+
 EXPORT_SYMBOL(fput);
 
 struct file *fget(unsigned int fd)
@@ -333,157 +487,23 @@ void put_filp(struct file *file)
 {
 	if (atomic_long_dec_and_test(&file->f_count)) {
 		security_file_free(file);
-		file_sb_list_del(file);
 		file_free(file);
 	}
 }
 
-static inline int file_list_cpu(struct file *file)
-{
-#ifdef CONFIG_SMP
-	return file->f_sb_list_cpu;
-#else
-	return smp_processor_id();
-#endif
-}
-
-/* helper for file_sb_list_add to reduce ifdefs */
-static inline void __file_sb_list_add(struct file *file, struct super_block *sb)
+static void __init fput_defer_init(void)
 {
-	struct list_head *list;
-#ifdef CONFIG_SMP
 	int cpu;
-	cpu = smp_processor_id();
-	file->f_sb_list_cpu = cpu;
-	list = per_cpu_ptr(sb->s_files, cpu);
-#else
-	list = &sb->s_files;
-#endif
-	list_add(&file->f_u.fu_list, list);
-}
 
-/**
- * file_sb_list_add - add a file to the sb's file list
- * @file: file to add
- * @sb: sb to add it to
- *
- * Use this function to associate a file with the superblock of the inode it
- * refers to.
- */
-void file_sb_list_add(struct file *file, struct super_block *sb)
-{
-	lg_local_lock(files_lglock);
-	__file_sb_list_add(file, sb);
-	lg_local_unlock(files_lglock);
-}
+	for_each_possible_cpu(cpu) {
+		struct fput_defer *fdef = &per_cpu(fput_defer_list, cpu);
 
-/**
- * file_sb_list_del - remove a file from the sb's file list
- * @file: file to remove
- * @sb: sb to remove it from
- *
- * Use this function to remove a file from its superblock.
- */
-void file_sb_list_del(struct file *file)
-{
-	if (!list_empty(&file->f_u.fu_list)) {
-		lg_local_lock_cpu(files_lglock, file_list_cpu(file));
-		list_del_init(&file->f_u.fu_list);
-		lg_local_unlock_cpu(files_lglock, file_list_cpu(file));
+		spin_lock_init(&fdef->lock);
+		INIT_LIST_HEAD(&fdef->list);
+		INIT_WORK(&fdef->wq, fput_defer_work);
 	}
 }
 
-#ifdef CONFIG_SMP
-
-/*
- * These macros iterate all files on all CPUs for a given superblock.
- * files_lglock must be held globally.
- */
-#define do_file_list_for_each_entry(__sb, __file)		\
-{								\
-	int i;							\
-	for_each_possible_cpu(i) {				\
-		struct list_head *list;				\
-		list = per_cpu_ptr((__sb)->s_files, i);		\
-		list_for_each_entry((__file), list, f_u.fu_list)
-
-#define while_file_list_for_each_entry				\
-	}							\
-}
-
-#else
-
-#define do_file_list_for_each_entry(__sb, __file)		\
-{								\
-	struct list_head *list;					\
-	list = &(sb)->s_files;					\
-	list_for_each_entry((__file), list, f_u.fu_list)
-
-#define while_file_list_for_each_entry				\
-}
-
-#endif
-
-int fs_may_remount_ro(struct super_block *sb)
-{
-	struct file *file;
-	/* Check that no files are currently opened for writing. */
-	lg_global_lock(files_lglock);
-	do_file_list_for_each_entry(sb, file) {
-		struct inode *inode = file->f_path.dentry->d_inode;
-
-		/* File with pending delete? */
-		if (inode->i_nlink == 0)
-			goto too_bad;
-
-		/* Writeable file? */
-		if (S_ISREG(inode->i_mode) && (file->f_mode & FMODE_WRITE))
-			goto too_bad;
-	} while_file_list_for_each_entry;
-	lg_global_unlock(files_lglock);
-	return 1; /* Tis' cool bro. */
-too_bad:
-	lg_global_unlock(files_lglock);
-	return 0;
-}
-
-/**
- *	mark_files_ro - mark all files read-only
- *	@sb: superblock in question
- *
- *	All files are marked read-only.  We don't care about pending
- *	delete files so this should be used in 'force' mode only.
- */
-void mark_files_ro(struct super_block *sb)
-{
-	struct file *f;
-
-retry:
-	lg_global_lock(files_lglock);
-	do_file_list_for_each_entry(sb, f) {
-		struct vfsmount *mnt;
-		if (!S_ISREG(f->f_path.dentry->d_inode->i_mode))
-		       continue;
-		if (!file_count(f))
-			continue;
-		if (!(f->f_mode & FMODE_WRITE))
-			continue;
-		spin_lock(&f->f_lock);
-		f->f_mode &= ~FMODE_WRITE;
-		spin_unlock(&f->f_lock);
-		if (file_check_writeable(f) != 0)
-			continue;
-		file_release_write(f);
-		mnt = mntget(f->f_path.mnt);
-		/* This can sleep, so we can't hold the spinlock. */
-		lg_global_unlock(files_lglock);
-		mnt_drop_write(mnt);
-		mntput(mnt);
-		goto retry;
-	} while_file_list_for_each_entry;
-	lg_global_unlock(files_lglock);
-}
-
 void __init files_init(unsigned long mempages)
 { 
 	unsigned long n;
@@ -499,6 +519,6 @@ void __init files_init(unsigned long mempages)
 	n = (mempages * (PAGE_SIZE / 1024)) / 10;
 	files_stat.max_files = max_t(unsigned long, n, NR_FILE);
 	files_defer_init();
-	lg_lock_init(files_lglock);
+	fput_defer_init();
 	percpu_counter_init(&nr_files, 0);
 } 
@@ -71,10 +71,16 @@ extern void umount_tree(struct vfsmount *, int, struct list_head *);
 extern struct vfsmount *copy_tree(struct vfsmount *, struct dentry *, int);
 
 extern void __init mnt_init(void);
+extern int sb_prepare_remount_readonly(struct super_block *);
 
 DECLARE_BRLOCK(vfsmount_lock);
 
 
+/*
+ * namei.c
+ */
+extern void __init namei_init(void);
+
 /*
  * fs_struct.c
  */
@@ -83,10 +89,8 @@ extern void chroot_fs_refs(struct path *, struct path *);
 /*
  * file_table.c
  */
-extern void file_sb_list_add(struct file *f, struct super_block *sb);
-extern void file_sb_list_del(struct file *f);
-extern void mark_files_ro(struct super_block *);
 extern struct file *get_empty_filp(void);
+extern void flush_deferred_fput(void);
 
 /*
  * super.c
@@ -102,6 +106,11 @@ struct nameidata;
 extern struct file *nameidata_to_filp(struct nameidata *);
 extern void release_open_intent(struct nameidata *);
 
+/*
+ * fs-writeback.c
+ */
+extern void inode_wb_list_del(struct inode *inode);
+
 /*
  * inode.c
  */
@@ -32,6 +32,7 @@
 #include <linux/fcntl.h>
 #include <linux/device_cgroup.h>
 #include <linux/fs_struct.h>
+#include <linux/hash.h>
 #include <asm/uaccess.h>
 
 #include "internal.h"
@@ -1050,13 +1051,276 @@ out_fail:
 	return retval;
 }
 
+/*
+ * RCU path walk
+ *
+ * Cached path components are resolved under rcu_read_lock() and the
+ * vfsmount_lock read side without taking a reference on (or otherwise
+ * writing to) any of the intermediate dentries and vfsmounts.  Each
+ * dentry is validated against its d_seq seqcount instead: a child found
+ * by __d_lookup_rcu() is only trusted once both its own d_seq and its
+ * parent's d_seq are found unchanged.  Only the final dentry and
+ * vfsmount get a reference.
+ *
+ * Anything that is not plain cached lookup - a cache miss, a negative
+ * dentry, "..", symlinks, ->d_revalidate, ->d_hash, ->d_compare,
+ * ->permission, ACLs that are not cached as absent, an LSM permission
+ * hook, or a filesystem whose inodes are not RCU freed - makes the walk
+ * give up with -ECHILD and the caller redoes the lookup in ref-walk
+ * mode from the start.
+ */
+static DEFINE_PER_CPU(unsigned long, nr_rcu_walk);
+static DEFINE_PER_CPU(unsigned long, nr_rcu_walk_fallback);
+
+struct path_walk_stat_t path_walk_stat;
+
+#if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
+int proc_path_walk_state(ctl_table *table, int write,
+			 void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	unsigned long nr_rcu = 0, nr_fallback = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		nr_rcu += per_cpu(nr_rcu_walk, cpu);
+		nr_fallback += per_cpu(nr_rcu_walk_fallback, cpu);
+	}
+	path_walk_stat.nr_rcu = nr_rcu;
+	path_walk_stat.nr_fallback = nr_fallback;
+	return proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
+}
+#endif
+
+/*
+ * Can we look at this dentry and its inode without holding references?
+ */
+static inline int dentry_rcu_walk_ok(struct dentry *dentry)
+{
+	const struct dentry_operations *op = dentry->d_op;
+	struct super_block *sb = dentry->d_sb;
+
+	if (op && (op->d_revalidate || op->d_hash || op->d_compare))
+		return 0;
+	return !sb->s_op->destroy_inode ||
+		(sb->s_type->fs_flags & FS_RCU_INODES);
+}
+
+/*
+ * exec_permission() for RCU walk: only the DAC checks that can be done
+ * without blocking, anything else returns -ECHILD.
+ */
+static int exec_permission_rcu(struct inode *inode)
+{
+	if (inode->i_op->permission)
+		return -ECHILD;
+#ifdef CONFIG_FS_POSIX_ACL
+	/* the mode bits are only the whole story if there is no ACL */
+	if (IS_POSIXACL(inode) && inode->i_op->check_acl &&
+	    ACCESS_ONCE(inode->i_acl) != NULL)
+		return -ECHILD;
+#endif
+	if (acl_permission_check(inode, MAY_EXEC, NULL))
+		return -ECHILD;
+	return security_inode_exec_permission_rcu(inode);
+}
+
+/*
+ * Look up one cached component below @path in RCU mode and step onto it,
+ * crossing any mounts on top of it.  @seq is the d_seq of the current
+ * dentry on entry and of the new one on return.
+ */
+static int walk_component_rcu(struct path *path, struct qstr *name,
+			      struct inode **inode, unsigned *seq)
+{
+	struct dentry *parent = path->dentry;
+	struct dentry *dentry;
+	unsigned dseq;
+
+	dentry = __d_lookup_rcu(parent, name, &dseq);
+	if (!dentry)
+		return -ECHILD;
+	*inode = dentry->d_inode;
+	if (read_seqcount_retry(&dentry->d_seq, dseq))
+		return -ECHILD;
+	/* the child is only valid if the parent did not change under us */
+	if (read_seqcount_retry(&parent->d_seq, *seq))
+		return -ECHILD;
+	if (!*inode || !dentry_rcu_walk_ok(dentry))
+		return -ECHILD;
+
+	path->dentry = dentry;
+	*seq = dseq;
+	while (d_mountpoint(dentry)) {
+		struct vfsmount *mounted = __lookup_mnt(path->mnt, dentry, 1);
+		if (!mounted)
+			break;
+		path->mnt = mounted;
+		path->dentry = dentry = mounted->mnt_root;
+		*seq = read_seqcount_begin(&dentry->d_seq);
+		*inode = dentry->d_inode;
+		if (!*inode || !dentry_rcu_walk_ok(dentry))
+			return -ECHILD;
+	}
+	return 0;
+}
+
+/*
+ * Returns 0 with nd->path referenced as path_init() + path_walk() would
+ * have left it, or -ECHILD with nothing to undo if the caller has to do a
+ * ref-walk instead.  Errors such as -ENOENT are never returned: they are
+ * left for the ref-walk to report.
+ */
+static int path_lookup_rcu(int dfd, const char *name, unsigned int flags,
+			   struct nameidata *nd)
+{
+	struct fs_struct *fs = current->fs;
+	unsigned int lookup_flags = flags;
+	struct inode *inode;
+	struct path path;
+	struct qstr this;
+	unsigned seq, fs_seq;
+
+	if (flags & LOOKUP_REVAL)
+		return -ECHILD;
+	if (*name != '/' && dfd != AT_FDCWD)
+		return -ECHILD;
+
+	br_read_lock(vfsmount_lock);
+	rcu_read_lock();
+
+	/*
+	 * fs->root and fs->pwd hold references while we read their d_seq.
+	 * The dentry stays readable after that under rcu_read_lock(), and
+	 * its mount under vfsmount_lock, which the final mntput() needs
+	 * for write; the d_seq check at the end catches a dentry killed
+	 * meanwhile.
+	 */
+	do {
+		fs_seq = read_seqcount_begin(&fs->seq);
+		path = (*name == '/') ? fs->root : fs->pwd;
+		seq = read_seqcount_begin(&path.dentry->d_seq);
+	} while (read_seqcount_retry(&fs->seq, fs_seq));
+	inode = path.dentry->d_inode;
+	if (!inode || !dentry_rcu_walk_ok(path.dentry))
+		goto fail;
+
+	nd->last_type = LAST_ROOT;
+	while (*name == '/')
+		name++;
+	if (!*name)
+		goto last_reval;
+
+	for (;;) {
+		unsigned long hash;
+		unsigned int c;
+
+		if (exec_permission_rcu(inode))
+			goto fail;
+
+		this.name = name;
+		c = *(const unsigned char *)name;
+
+		hash = init_name_hash();
+		do {
+			name++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)name;
+		} while (c && (c != '/'));
+		this.len = name - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		if (!c)
+			goto last_component;
+		while (*++name == '/');
+		if (!*name) {
+			lookup_flags |= LOOKUP_FOLLOW | LOOKUP_DIRECTORY;
+			goto last_component;
+		}
+
+		if (this.name[0] == '.') {
+			if (this.len == 1)
+				continue;
+			if (this.len == 2 && this.name[1] == '.')
+				goto fail;
+		}
+		if (walk_component_rcu(&path, &this, &inode, &seq))
+			goto fail;
+		if (inode->i_op->follow_link || !inode->i_op->lookup)
+			goto fail;
+	}
+
+last_component:
+	if (lookup_flags & LOOKUP_PARENT) {
+		nd->last = this;
+		nd->last_type = LAST_NORM;
+		if (this.name[0] != '.')
+			goto done;
+		if (this.len == 1)
+			nd->last_type = LAST_DOT;
+		else if (this.len == 2 && this.name[1] == '.')
+			nd->last_type = LAST_DOTDOT;
+		else
+			goto done;
+		goto last_reval;
+	}
+	if (this.name[0] == '.') {
+		if (this.len == 1)
+			goto last_reval;
+		if (this.len == 2 && this.name[1] == '.')
+			goto fail;
+	}
+	if (walk_component_rcu(&path, &this, &inode, &seq))
+		goto fail;
+	if (follow_on_final(inode, lookup_flags))
+		goto fail;
+	if ((lookup_flags & LOOKUP_DIRECTORY) && !inode->i_op->lookup)
+		goto fail;
+	goto done;
+
+last_reval:
+	if (path.dentry->d_sb->s_type->fs_flags & FS_REVAL_DOT)
+		goto fail;
+done:
+	/* same rules as __d_lookup(): d_lock plus an unchanged d_seq */
+	spin_lock(&path.dentry->d_lock);
+	if (read_seqcount_retry(&path.dentry->d_seq, seq)) {
+		spin_unlock(&path.dentry->d_lock);
+		goto fail;
+	}
+	atomic_inc(&path.dentry->d_count);
+	spin_unlock(&path.dentry->d_lock);
+	mntget(path.mnt);
+	rcu_read_unlock();
+	br_read_unlock(vfsmount_lock);
+
+	nd->flags = flags;
+	nd->depth = 0;
+	nd->root.mnt = NULL;
+	nd->path = path;
+	this_cpu_inc(nr_rcu_walk);
+	return 0;
+
+fail:
+	rcu_read_unlock();
+	br_read_unlock(vfsmount_lock);
+	this_cpu_inc(nr_rcu_walk_fallback);
+	return -ECHILD;
+}
+
 /* Returns 0 and nd will be valid on success; Retuns error, otherwise. */
 static int do_path_lookup(int dfd, const char *name,
 				unsigned int flags, struct nameidata *nd)
 {
-	int retval = path_init(dfd, name, flags, nd);
+	int retval;
+
+	if (!path_lookup_rcu(dfd, name, flags, nd)) {
+		retval = 0;
+		goto out;
+	}
+	retval = path_init(dfd, name, flags, nd);
 	if (!retval)
 		retval = path_walk(name, nd);
+out:
 	if (unlikely(!retval && !audit_dummy_context() && nd->path.dentry &&
 				nd->path.dentry->d_inode))
 		audit_inode(name, nd->path.dentry);
@@ -1166,6 +1430,39 @@ static struct dentry *lookup_hash(struct nameidata *nd)
 	return __lookup_hash(&nd->last, nd->path.dentry, nd);
 }
 
+/*
+ * Directories of filesystems with FS_PARALLEL_DIROPS create and unlink
+ * without holding the directory's i_mutex across the filesystem call.
+ * Operations on the same name are instead serialised by a small hashed
+ * table of mutexes, indexed by directory and name hash, so operations on
+ * distinct names usually get distinct locks.  The directory's i_mutex is
+ * still taken briefly to publish or drop the dentry, which keeps them
+ * ordered against rename, link and the other operations that take it.
+ */
+#define DIR_NAME_LOCK_BITS	8
+
+static struct mutex dir_name_locks[1 << DIR_NAME_LOCK_BITS];
+
+void __init namei_init(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(dir_name_locks); i++)
+		mutex_init(&dir_name_locks[i]);
+}
+
+static struct mutex *dir_name_lock(struct dentry *dir, struct qstr *name)
+{
+	unsigned long hash = (unsigned long)dir + name->hash;
+
+	return &dir_name_locks[hash_long(hash, DIR_NAME_LOCK_BITS)];
+}
+
+static inline int dir_parallel_ops(struct dentry *dir)
+{
+	return dir->d_sb->s_type->fs_flags & FS_PARALLEL_DIROPS;
+}
+
 static int __lookup_one_len(const char *name, struct qstr *this,
 		struct dentry *base, int len)
 {
@@ -1376,8 +1673,12 @@ void unlock_rename(struct dentry *p1, struct dentry *p2)
 	}
 }
 
-int vfs_create(struct inode *dir, struct dentry *dentry, int mode,
-		struct nameidata *nd)
+/*
+ * vfs_create() without the fsnotify event, for parallel_open_create(),
+ * which only reports the file once it is visible.
+ */
+static int __vfs_create(struct inode *dir, struct dentry *dentry, int mode,
+			struct nameidata *nd)
 {
 	int error = may_create(dir, dentry);
 
@@ -1391,7 +1692,14 @@ int vfs_create(struct inode *dir, struct dentry *dentry, int mode,
 	error = security_inode_create(dir, dentry, mode);
 	if (error)
 		return error;
-	error = dir->i_op->create(dir, dentry, mode, nd);
+	return dir->i_op->create(dir, dentry, mode, nd);
+}
+
+int vfs_create(struct inode *dir, struct dentry *dentry, int mode,
+		struct nameidata *nd)
+{
+	int error = __vfs_create(dir, dentry, mode, nd);
+
 	if (!error)
 		fsnotify_create(dir, dentry);
 	return error;
@@ -1496,6 +1804,89 @@ out_unlock:
 	return may_open(&nd->path, 0, open_flag & ~O_TRUNC);
 }
 
+/*
+ * O_CREAT in a FS_PARALLEL_DIROPS directory.  The new file is created on
+ * an unhashed dentry under the name lock only, and becomes visible when
+ * the dentry is hashed under the directory's i_mutex.  Returns -EAGAIN if
+ * the name already exists or is being created by someone holding i_mutex;
+ * the caller then falls back to the ordinary path, which sorts it out.
+ */
+static int parallel_open_create(struct nameidata *nd, struct path *path,
+				int open_flag, int mode)
+{
+	struct dentry *dir = nd->path.dentry;
+	struct inode *inode = dir->d_inode;
+	struct mutex *name_lock;
+	struct dentry *dentry, *old;
+	int error;
+
+	error = exec_permission(inode);
+	if (error)
+		return error;
+
+	name_lock = dir_name_lock(dir, &nd->last);
+	mutex_lock(name_lock);
+
+	old = d_lookup(dir, &nd->last);
+	if (old && old->d_inode) {
+		dput(old);
+		error = -EAGAIN;
+		goto out_unlock;
+	}
+	dput(old);
+
+	dentry = d_alloc(dir, &nd->last);
+	error = -ENOMEM;
+	if (!dentry)
+		goto out_unlock;
+
+	if (!IS_POSIXACL(inode))
+		mode &= ~current_umask();
+	error = security_path_mknod(&nd->path, dentry, mode, 0);
+	if (!error)
+		error = __vfs_create(inode, dentry, mode, nd);
+	if (error)
+		goto out_dput;
+
+	mutex_lock_nested(&inode->i_mutex, I_MUTEX_PARENT);
+	old = d_lookup(dir, &nd->last);
+	if (IS_DEADDIR(inode) || (old && old->d_inode)) {
+		/*
+		 * Lost a race against a creator holding i_mutex: undo.
+		 * Nobody has seen the file, nor been told about it.
+		 */
+		mutex_lock(&dentry->d_inode->i_mutex);
+		inode->i_op->unlink(inode, dentry);
+		mutex_unlock(&dentry->d_inode->i_mutex);
+		mutex_unlock(&inode->i_mutex);
+		dput(old);
+		error = -EAGAIN;
+		goto out_dput;
+	}
+	if (old) {
+		/* replace the negative dentry left by an earlier unlink */
+		d_drop(old);
+		dput(old);
+	}
+	d_rehash(dentry);
+	fsnotify_create(inode, dentry);
+	mutex_unlock(&inode->i_mutex);
+	mutex_unlock(name_lock);
+
+	path->dentry = dentry;
+	path->mnt = nd->path.mnt;
+	dput(nd->path.dentry);
+	nd->path.dentry = dentry;
+	/* Don't check for write permission, don't truncate */
+	return may_open(&nd->path, 0, open_flag & ~O_TRUNC);
+
+out_dput:
+	dput(dentry);
+out_unlock:
+	mutex_unlock(name_lock);
+	return error;
+}
+
 /*
  * Note that while the flag value (low two bits) for sys_open means:
  *	00 - read-only
@@ -1584,6 +1975,28 @@ exit:
 	return ERR_PTR(error);
 }
 
+/*
+ * Open a freshly created file; drops the write access taken on the mount
+ * before the create.
+ */
+static struct file *finish_create(struct nameidata *nd, int acc_mode)
+{
+	struct file *filp;
+	int error;
+
+	filp = nameidata_to_filp(nd);
+	mnt_drop_write(nd->path.mnt);
+	path_put(&nd->path);
+	if (!IS_ERR(filp)) {
+		error = ima_file_check(filp, acc_mode);
+		if (error) {
+			fput(filp);
+			filp = ERR_PTR(error);
+		}
+	}
+	return filp;
+}
+
 static struct file *do_last(struct nameidata *nd, struct path *path,
 			    int open_flag, int acc_mode,
 			    int mode, const char *pathname)
@@ -1641,6 +2054,18 @@ static struct file *do_last(struct nameidata *nd, struct path *path,
 	}
 
 	/* OK, it's O_CREAT */
+	if (dir_parallel_ops(dir) && !IS_ERR(nd->intent.open.file)) {
+		error = mnt_want_write(nd->path.mnt);
+		if (error)
+			goto exit;
+		error = parallel_open_create(nd, path, open_flag, mode);
+		if (!error)
+			return finish_create(nd, acc_mode);
+		mnt_drop_write(nd->path.mnt);
+		if (error != -EAGAIN)
+			goto exit;
+	}
+
 	mutex_lock(&dir->d_inode->i_mutex);
 
 	path->dentry = lookup_hash(nd);
@@ -1674,17 +2099,7 @@ static struct file *do_last(struct nameidata *nd, struct path *path,
 			mnt_drop_write(nd->path.mnt);
 			goto exit;
 		}
-		filp = nameidata_to_filp(nd);
-		mnt_drop_write(nd->path.mnt);
-		path_put(&nd->path);
-		if (!IS_ERR(filp)) {
-			error = ima_file_check(filp, acc_mode);
-			if (error) {
-				fput(filp);
-				filp = ERR_PTR(error);
-			}
-		}
-		return filp;
+		return finish_create(nd, acc_mode);
 	}
 
 	/*
@@ -1774,18 +2189,21 @@ struct file *do_filp_open(int dfd, const char *pathname,
 
 	/* find the parent */
 reval:
-	error = path_init(dfd, pathname, LOOKUP_PARENT, &nd);
-	if (error)
-		return ERR_PTR(error);
-	if (force_reval)
-		nd.flags |= LOOKUP_REVAL;
+	if (force_reval || path_lookup_rcu(dfd, pathname, LOOKUP_PARENT, &nd)) {
+		error = path_init(dfd, pathname, LOOKUP_PARENT, &nd);
+		if (error)
+			return ERR_PTR(error);
+		if (force_reval)
+			nd.flags |= LOOKUP_REVAL;
 
-	current->total_link_count = 0;
-	error = link_path_walk(pathname, &nd);
-	if (error) {
-		filp = ERR_PTR(error);
-		goto out;
+		current->total_link_count = 0;
+		error = link_path_walk(pathname, &nd);
+		if (error) {
+			filp = ERR_PTR(error);
+			goto out;
+		}
 	}
+	current->total_link_count = 0;
 	if (unlikely(!audit_dummy_context()) && (open_flag & O_CREAT))
 		audit_inode(pathname, nd.path.dentry);
 
@@ -2257,6 +2675,53 @@ int vfs_unlink(struct inode *dir, struct dentry *dentry)
 	return error;
 }
 
+/*
+ * vfs_unlink() for FS_PARALLEL_DIROPS directories.  Called with the name
+ * lock and dir->i_mutex held; the dentry is unhashed and dir->i_mutex is
+ * dropped before ->unlink is called.  Returns with dir->i_mutex released.
+ */
+static int parallel_unlink(struct inode *dir, struct dentry *dentry)
+{
+	struct inode *inode = dentry->d_inode;
+	int error = may_delete(dir, dentry, 0);
+
+	if (!error && !dir->i_op->unlink)
+		error = -EPERM;
+	if (error)
+		goto out_unlock_dir;
+
+	mutex_lock(&inode->i_mutex);
+	if (d_mountpoint(dentry))
+		error = -EBUSY;
+	else
+		error = security_inode_unlink(dir, dentry);
+	if (error) {
+		mutex_unlock(&inode->i_mutex);
+		goto out_unlock_dir;
+	}
+	d_drop(dentry);
+	mutex_unlock(&dir->i_mutex);
+
+	error = dir->i_op->unlink(dir, dentry);
+	if (!error)
+		dont_mount(dentry);
+	mutex_unlock(&inode->i_mutex);
+
+	if (unlikely(error)) {
+		mutex_lock_nested(&dir->i_mutex, I_MUTEX_PARENT);
+		d_rehash(dentry);
+		mutex_unlock(&dir->i_mutex);
+		return error;
+	}
+	fsnotify_link_count(inode);
+	d_delete(dentry);
+	return 0;
+
+out_unlock_dir:
+	mutex_unlock(&dir->i_mutex);
+	return error;
+}
+
 /*
  * Make sure that the actual truncation of the file will occur outside its
  * directory's i_mutex.  Truncate can take a long time if there is a lot of
@@ -2270,6 +2735,8 @@ static long do_unlinkat(int dfd, const char __user *pathname)
 	struct dentry *dentry;
 	struct nameidata nd;
 	struct inode *inode = NULL;
+	struct mutex *name_lock = NULL;
+	int dir_locked = 1;
 
 	error = user_path_parent(dfd, pathname, &nd, &name);
 	if (error)
@@ -2281,6 +2748,10 @@ static long do_unlinkat(int dfd, const char __user *pathname)
 
 	nd.flags &= ~LOOKUP_PARENT;
 
+	if (dir_parallel_ops(nd.path.dentry)) {
+		name_lock = dir_name_lock(nd.path.dentry, &nd.last);
+		mutex_lock(name_lock);
+	}
 	mutex_lock_nested(&nd.path.dentry->d_inode->i_mutex, I_MUTEX_PARENT);
 	dentry = lookup_hash(&nd);
 	error = PTR_ERR(dentry);
@@ -2297,13 +2768,20 @@ static long do_unlinkat(int dfd, const char __user *pathname)
 		error = security_path_unlink(&nd.path, dentry);
 		if (error)
 			goto exit3;
-		error = vfs_unlink(nd.path.dentry->d_inode, dentry);
+		if (name_lock && inode) {
+			error = parallel_unlink(nd.path.dentry->d_inode, dentry);
+			dir_locked = 0;
+		} else
+			error = vfs_unlink(nd.path.dentry->d_inode, dentry);
 exit3:
 		mnt_drop_write(nd.path.mnt);
 	exit2:
 		dput(dentry);
 	}
-	mutex_unlock(&nd.path.dentry->d_inode->i_mutex);
+	if (dir_locked)
+		mutex_unlock(&nd.path.dentry->d_inode->i_mutex);
+	if (name_lock)
+		mutex_unlock(name_lock);
 	if (inode)
 		iput(inode);	/* truncate the inode here */
 exit1:
@@ -154,7 +154,9 @@ struct vfsmount *alloc_vfsmnt(const char *name)
 				goto out_free_id;
 		}
 
-		atomic_set(&mnt->mnt_count, 1);
+		if (percpu_refcount_init(&mnt->mnt_count, 1))
+			goto out_free_devname;
+
 		INIT_LIST_HEAD(&mnt->mnt_hash);
 		INIT_LIST_HEAD(&mnt->mnt_child);
 		INIT_LIST_HEAD(&mnt->mnt_mounts);
@@ -163,13 +165,14 @@ struct vfsmount *alloc_vfsmnt(const char *name)
 		INIT_LIST_HEAD(&mnt->mnt_share);
 		INIT_LIST_HEAD(&mnt->mnt_slave_list);
 		INIT_LIST_HEAD(&mnt->mnt_slave);
+		INIT_LIST_HEAD(&mnt->mnt_instance);
 #ifdef CONFIG_FSNOTIFY
 		INIT_HLIST_HEAD(&mnt->mnt_fsnotify_marks);
 #endif
 #ifdef CONFIG_SMP
 		mnt->mnt_writers = alloc_percpu(int);
 		if (!mnt->mnt_writers)
-			goto out_free_devname;
+			goto out_free_count;
 #else
 		mnt->mnt_writers = 0;
 #endif
@@ -177,9 +180,11 @@ struct vfsmount *alloc_vfsmnt(const char *name)
 	return mnt;
 
 #ifdef CONFIG_SMP
+out_free_count:
+	percpu_refcount_destroy(&mnt->mnt_count);
+#endif
 out_free_devname:
 	kfree(mnt->mnt_devname);
-#endif
 out_free_id:
 	mnt_free_id(mnt);
 out_free_cache:
@@ -216,6 +221,19 @@ int __mnt_is_readonly(struct vfsmount *mnt)
 }
 EXPORT_SYMBOL_GPL(__mnt_is_readonly);
 
+/*
+ * Like __mnt_is_readonly(), but also refuses writers while a remount
+ * read-only is checking the superblock, see sb_prepare_remount_readonly().
+ */
+static int mnt_is_readonly(struct vfsmount *mnt)
+{
+	if (mnt->mnt_sb->s_readonly_remount)
+		return 1;
+	/* order against do_remount_sb() setting MS_RDONLY */
+	smp_rmb();
+	return __mnt_is_readonly(mnt);
+}
+
 static inline void inc_mnt_writers(struct vfsmount *mnt)
 {
 #ifdef CONFIG_SMP
@@ -288,7 +306,7 @@ int mnt_want_write(struct vfsmount *mnt)
 	 * MNT_WRITE_HOLD is cleared.
 	 */
 	smp_rmb();
-	if (__mnt_is_readonly(mnt)) {
+	if (mnt_is_readonly(mnt)) {
 		dec_mnt_writers(mnt);
 		ret = -EROFS;
 		goto out;
@@ -314,7 +332,7 @@ EXPORT_SYMBOL_GPL(mnt_want_write);
 int mnt_clone_write(struct vfsmount *mnt)
 {
 	/* superblock may be r/o */
-	if (__mnt_is_readonly(mnt))
+	if (mnt_is_readonly(mnt))
 		return -EROFS;
 	preempt_disable();
 	inc_mnt_writers(mnt);
@@ -398,6 +416,41 @@ static int mnt_make_readonly(struct vfsmount *mnt)
 	return ret;
 }
 
+/**
+ * sb_prepare_remount_readonly - check a superblock for writers
+ * @sb: the superblock to be remounted read-only
+ *
+ * Fails with -EBUSY if any mount of @sb has writers, which includes
+ * every regular file open for write.  Otherwise sets s_readonly_remount,
+ * which keeps new writers out until do_remount_sb() clears it again.
+ */
+int sb_prepare_remount_readonly(struct super_block *sb)
+{
+	struct vfsmount *mnt;
+	int err = 0;
+
+	br_write_lock(vfsmount_lock);
+	list_for_each_entry(mnt, &sb->s_mounts, mnt_instance) {
+		if (mnt->mnt_flags & MNT_READONLY)
+			continue;
+		/* see mnt_make_readonly() */
+		mnt->mnt_flags |= MNT_WRITE_HOLD;
+		smp_mb();
+		if (count_mnt_writers(mnt) > 0) {
+			err = -EBUSY;
+			break;
+		}
+	}
+	if (!err) {
+		sb->s_readonly_remount = 1;
+		smp_wmb();
+	}
+	list_for_each_entry(mnt, &sb->s_mounts, mnt_instance)
+		mnt->mnt_flags &= ~MNT_WRITE_HOLD;
+	br_write_unlock(vfsmount_lock);
+	return err;
+}
+
 static void __mnt_unmake_readonly(struct vfsmount *mnt)
 {
 	br_write_lock(vfsmount_lock);
@@ -417,6 +470,7 @@ void free_vfsmnt(struct vfsmount *mnt)
 {
 	kfree(mnt->mnt_devname);
 	mnt_free_id(mnt);
+	percpu_refcount_destroy(&mnt->mnt_count);
 #ifdef CONFIG_SMP
 	free_percpu(mnt->mnt_writers);
 #endif
@@ -540,8 +594,10 @@ static void commit_tree(struct vfsmount *mnt)
 	BUG_ON(parent == mnt);
 
 	list_add_tail(&head, &mnt->mnt_list);
-	list_for_each_entry(m, &head, mnt_list)
+	list_for_each_entry(m, &head, mnt_list) {
 		m->mnt_ns = n;
+		atomic_inc(&m->mnt_longterm);
+	}
 	list_splice(&head, n->list.prev);
 
 	list_add_tail(&mnt->mnt_hash, mount_hashtable +
@@ -600,6 +656,9 @@ static struct vfsmount *clone_mnt(struct vfsmount *old, struct dentry *root,
 		mnt->mnt_root = dget(root);
 		mnt->mnt_mountpoint = mnt->mnt_root;
 		mnt->mnt_parent = mnt;
+		br_write_lock(vfsmount_lock);
+		list_add_tail(&mnt->mnt_instance, &sb->s_mounts);
+		br_write_unlock(vfsmount_lock);
 
 		if (flag & CL_SLAVE) {
 			list_add(&mnt->mnt_slave, &old->mnt_slave_list);
@@ -639,10 +698,13 @@ static inline void __mntput(struct vfsmount *mnt)
 	 * to make r/w->r/o transitions.
 	 */
 	/*
-	 * atomic_dec_and_lock() used to deal with ->mnt_count decrements
-	 * provides barriers, so count_mnt_writers() below is safe.  AV
+	 * vfsmount_lock held for write while the count was found to be zero
+	 * provides barriers, so count_mnt_writers() below is safe.
 	 */
 	WARN_ON(count_mnt_writers(mnt));
+	br_write_lock(vfsmount_lock);
+	list_del(&mnt->mnt_instance);
+	br_write_unlock(vfsmount_lock);
 	fsnotify_vfsmount_delete(mnt);
 	dput(mnt->mnt_root);
 	free_vfsmnt(mnt);
@@ -652,10 +714,23 @@ static inline void __mntput(struct vfsmount *mnt)
 void mntput_no_expire(struct vfsmount *mnt)
 {
 repeat:
-	if (atomic_add_unless(&mnt->mnt_count, -1, 1))
+	/*
+	 * A long-term user keeps the count above zero, so this reference
+	 * cannot be the last one.  mnt_make_shortterm() and the zero check
+	 * below take vfsmount_lock for write, which cannot happen while we
+	 * hold it for read.
+	 */
+	br_read_lock(vfsmount_lock);
+	if (likely(atomic_read(&mnt->mnt_longterm))) {
+		percpu_refcount_dec(&mnt->mnt_count);
+		br_read_unlock(vfsmount_lock);
 		return;
+	}
+	br_read_unlock(vfsmount_lock);
+
 	br_write_lock(vfsmount_lock);
-	if (!atomic_dec_and_test(&mnt->mnt_count)) {
+	percpu_refcount_dec(&mnt->mnt_count);
+	if (percpu_refcount_sum(&mnt->mnt_count)) {
 		br_write_unlock(vfsmount_lock);
 		return;
 	}
@@ -664,7 +739,7 @@ repeat:
 		__mntput(mnt);
 		return;
 	}
-	atomic_add(mnt->mnt_pinned + 1, &mnt->mnt_count);
+	percpu_refcount_add(&mnt->mnt_count, mnt->mnt_pinned + 1);
 	mnt->mnt_pinned = 0;
 	br_write_unlock(vfsmount_lock);
 	acct_auto_close_mnt(mnt);
@@ -672,6 +747,34 @@ repeat:
 }
 EXPORT_SYMBOL(mntput_no_expire);
 
+/**
+ * mnt_make_longterm - mark a mount as having a long-term user
+ * @mnt: the mount
+ *
+ * The caller must hold a reference that it will not drop until after
+ * the matching mnt_make_shortterm().  In return mntput() of every other
+ * reference stays on the local CPU.
+ */
+void mnt_make_longterm(struct vfsmount *mnt)
+{
+	atomic_inc(&mnt->mnt_longterm);
+}
+EXPORT_SYMBOL(mnt_make_longterm);
+
+/**
+ * mnt_make_shortterm - drop a long-term user of a mount
+ * @mnt: the mount
+ */
+void mnt_make_shortterm(struct vfsmount *mnt)
+{
+	if (atomic_add_unless(&mnt->mnt_longterm, -1, 1))
+		return;
+	br_write_lock(vfsmount_lock);
+	atomic_dec(&mnt->mnt_longterm);
+	br_write_unlock(vfsmount_lock);
+}
+EXPORT_SYMBOL(mnt_make_shortterm);
+
 void mnt_pin(struct vfsmount *mnt)
 {
 	br_write_lock(vfsmount_lock);
@@ -685,7 +788,7 @@ void mnt_unpin(struct vfsmount *mnt)
 {
 	br_write_lock(vfsmount_lock);
 	if (mnt->mnt_pinned) {
-		atomic_inc(&mnt->mnt_count);
+		percpu_refcount_inc(&mnt->mnt_count);
 		mnt->mnt_pinned--;
 	}
 	br_write_unlock(vfsmount_lock);
@@ -985,12 +1088,12 @@ int may_umount_tree(struct vfsmount *mnt)
 	int minimum_refs = 0;
 	struct vfsmount *p;
 
-	br_read_lock(vfsmount_lock);
+	br_write_lock(vfsmount_lock);
 	for (p = mnt; p; p = next_mnt(p, mnt)) {
-		actual_refs += atomic_read(&p->mnt_count);
+		actual_refs += percpu_refcount_sum(&p->mnt_count);
 		minimum_refs += 2;
 	}
-	br_read_unlock(vfsmount_lock);
+	br_write_unlock(vfsmount_lock);
 
 	if (actual_refs > minimum_refs)
 		return 0;
@@ -1017,10 +1120,10 @@ int may_umount(struct vfsmount *mnt)
 {
 	int ret = 1;
 	down_read(&namespace_sem);
-	br_read_lock(vfsmount_lock);
+	br_write_lock(vfsmount_lock);
 	if (propagate_mount_busy(mnt, 2))
 		ret = 0;
-	br_read_unlock(vfsmount_lock);
+	br_write_unlock(vfsmount_lock);
 	up_read(&namespace_sem);
 	return ret;
 }
@@ -1069,6 +1172,8 @@ void umount_tree(struct vfsmount *mnt, int propagate, struct list_head *kill)
 		list_del_init(&p->mnt_expire);
 		list_del_init(&p->mnt_list);
 		__touch_mnt_namespace(p->mnt_ns);
+		if (p->mnt_ns)
+			atomic_dec(&p->mnt_longterm);
 		p->mnt_ns = NULL;
 		list_del_init(&p->mnt_child);
 		if (p->mnt_parent != p) {
@@ -1091,6 +1196,9 @@ static int do_umount(struct vfsmount *mnt, int flags)
 	if (retval)
 		return retval;
 
+	/* files already closed must not keep the mount busy */
+	flush_deferred_fput();
+
 	/*
 	 * Allow userspace to request a mountpoint be expired rather than
 	 * unmounting unconditionally. Unmount only happens if:
@@ -1102,7 +1210,7 @@ static int do_umount(struct vfsmount *mnt, int flags)
 		    flags & (MNT_FORCE | MNT_DETACH))
 			return -EINVAL;
 
-		if (atomic_read(&mnt->mnt_count) != 2)
+		if (percpu_refcount_sum(&mnt->mnt_count) != 2)
 			return -EBUSY;
 
 		if (!xchg(&mnt->mnt_expiry_mark, 1))
@@ -1623,6 +1731,9 @@ static int do_remount(struct path *path, int flags, int mnt_flags,
 	if (path->dentry != path->mnt->mnt_root)
 		return -EINVAL;
 
+	if (flags & MS_RDONLY)
+		flush_deferred_fput();
+
 	down_write(&sb->s_umount);
 	if (flags & MS_BIND)
 		err = change_mount_flags(path->mnt, flags);
@@ -2122,6 +2233,7 @@ static struct mnt_namespace *dup_mnt_ns(struct mnt_namespace *mnt_ns,
 	q = new_ns->root;
 	while (p) {
 		q->mnt_ns = new_ns;
+		atomic_inc(&q->mnt_longterm);
 		if (fs) {
 			if (p == fs->root.mnt) {
 				rootmnt = p;
@@ -2173,6 +2285,7 @@ struct mnt_namespace *create_mnt_ns(struct vfsmount *mnt)
 	new_ns = alloc_mnt_ns();
 	if (!IS_ERR(new_ns)) {
 		mnt->mnt_ns = new_ns;
+		atomic_inc(&mnt->mnt_longterm);
 		new_ns->root = mnt;
 		list_add(&new_ns->list, &new_ns->root->mnt_list);
 	}
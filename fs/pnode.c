@@ -288,7 +288,7 @@ out:
  */
 static inline int do_refcount_check(struct vfsmount *mnt, int count)
 {
-	int mycount = atomic_read(&mnt->mnt_count) - mnt->mnt_ghosts;
+	int mycount = percpu_refcount_sum(&mnt->mnt_count) - mnt->mnt_ghosts;
 	return (mycount > count);
 }
 
@@ -90,6 +90,61 @@ generic_file_llseek_unlocked(struct file *file, loff_t offset, int origin)
 }
 EXPORT_SYMBOL(generic_file_llseek_unlocked);
 
+static loff_t lseek_execute(struct file *file, loff_t offset, loff_t maxsize)
+{
+	if (offset < 0 && __negative_fpos_check(file, offset, 0))
+		return -EINVAL;
+	if (offset > maxsize)
+		return -EINVAL;
+
+	if (offset != file->f_pos) {
+		file->f_pos = offset;
+		file->f_version = 0;
+	}
+	return offset;
+}
+
+/**
+ * generic_file_llseek_size - lockless llseek implementation with a size limit
+ * @file:	file structure to seek on
+ * @offset:	file offset to seek to
+ * @origin:	type of seek
+ * @maxsize:	largest offset the file may be positioned at
+ *
+ * Updates the file offset to the value specified by @offset and @origin
+ * without taking i_mutex.  i_size is sampled with i_size_read(), so a
+ * SEEK_END racing with a size change sees either the old or the new size.
+ * SEEK_CUR is serialised against other SEEK_CURs by file->f_lock; a
+ * concurrent read() or write() behaves as if it had used SEEK_SET.
+ */
+loff_t generic_file_llseek_size(struct file *file, loff_t offset, int origin,
+				loff_t maxsize)
+{
+	struct inode *inode = file->f_mapping->host;
+
+	switch (origin) {
+	case SEEK_END:
+		offset += i_size_read(inode);
+		break;
+	case SEEK_CUR:
+		/*
+		 * Here we special-case the lseek(fd, 0, SEEK_CUR)
+		 * position-querying operation.  Avoid rewriting the "same"
+		 * f_pos value back to the file because a concurrent read(),
+		 * write() or lseek() might have altered it
+		 */
+		if (offset == 0)
+			return file->f_pos;
+		spin_lock(&file->f_lock);
+		offset = lseek_execute(file, file->f_pos + offset, maxsize);
+		spin_unlock(&file->f_lock);
+		return offset;
+	}
+
+	return lseek_execute(file, offset, maxsize);
+}
+EXPORT_SYMBOL(generic_file_llseek_size);
+
 /**
  * generic_file_llseek - generic llseek implementation for regular files
  * @file:	file structure to seek on
@@ -98,17 +153,14 @@ EXPORT_SYMBOL(generic_file_llseek_unlocked);
  *
  * This is a generic implemenation of ->llseek useable for all normal local
  * filesystems.  It just updates the file offset to the value specified by
- * @offset and @origin under i_mutex.
+ * @offset and @origin, without taking i_mutex.
  */
 loff_t generic_file_llseek(struct file *file, loff_t offset, int origin)
 {
-	loff_t rval;
-
-	mutex_lock(&file->f_dentry->d_inode->i_mutex);
-	rval = generic_file_llseek_unlocked(file, offset, origin);
-	mutex_unlock(&file->f_dentry->d_inode->i_mutex);
+	struct inode *inode = file->f_mapping->host;
 
-	return rval;
+	return generic_file_llseek_size(file, offset, origin,
+					inode->i_sb->s_maxbytes);
 }
 EXPORT_SYMBOL(generic_file_llseek);
 
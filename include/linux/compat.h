@@ -361,6 +361,13 @@ extern ssize_t compat_rw_copy_check_uvector(int type,
 		unsigned long fast_segs, struct iovec *fast_pointer,
 		struct iovec **ret_pointer);
 
+struct spawn_action;
+asmlinkage long compat_sys_spawn(const char __user *filename,
+				 compat_uptr_t __user *argv,
+				 compat_uptr_t __user *envp,
+				 const struct spawn_action __user *actions,
+				 unsigned int nr_actions, unsigned int flags);
+
 extern void __user *compat_alloc_user_space(unsigned long len);
 
 #endif /* CONFIG_COMPAT */
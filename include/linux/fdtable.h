@@ -12,6 +12,7 @@
 #include <linux/types.h>
 #include <linux/init.h>
 #include <linux/fs.h>
+#include <linux/bitops.h>
 
 #include <asm/atomic.h>
 
@@ -52,7 +53,8 @@ struct files_struct {
    * written part on a separate cache line in SMP
    */
 	spinlock_t file_lock ____cacheline_aligned_in_smp;
-	int next_fd;
+	int next_fd;		/* no free fd below this, see alloc_fd() */
+	int resizing;		/* expand_fdtable() in progress */
 	struct embedded_fd_set close_on_exec_init;
 	struct embedded_fd_set open_fds_init;
 	struct file __rcu * fd_array[NR_OPEN_DEFAULT];
@@ -68,6 +70,29 @@ struct files_struct {
 #define files_fdtable(files) \
 		(rcu_dereference_check_fdtable((files), (files)->fdt))
 
+/*
+ * alloc_fd() claims descriptors without file_lock, so every update of
+ * open_fds and close_on_exec must be an atomic bitop, even under the lock.
+ */
+static inline void fdt_mark_open(struct fdtable *fdt, unsigned int fd)
+{
+	set_bit(fd, fdt->open_fds->fds_bits);
+}
+
+static inline void fdt_mark_free(struct fdtable *fdt, unsigned int fd)
+{
+	clear_bit(fd, fdt->open_fds->fds_bits);
+}
+
+static inline void fdt_set_cloexec(struct fdtable *fdt, unsigned int fd,
+				   int flag)
+{
+	if (flag)
+		set_bit(fd, fdt->close_on_exec->fds_bits);
+	else
+		clear_bit(fd, fdt->close_on_exec->fds_bits);
+}
+
 struct file_operations;
 struct vfsmount;
 struct dentry;
@@ -52,6 +52,18 @@ struct inodes_stat_t {
 	int dummy[5];		/* padding for sysctl ABI compatibility */
 };
 
+struct path_walk_stat_t {
+	unsigned long nr_rcu;		/* lookups completed in RCU mode */
+	unsigned long nr_fallback;	/* RCU lookups redone with refs */
+};
+
+struct fput_defer_stat_t {
+	unsigned long nr_queued;	/* files waiting for __fput() now */
+	unsigned long nr_deferred;	/* final fputs that were queued */
+	unsigned long nr_batches;	/* queues drained */
+	unsigned long max_batch;	/* largest queue drained at once */
+};
+
 
 #define NR_FILE  8192	/* this can well be larger on a larger system */
 
@@ -185,6 +197,18 @@ struct inodes_stat_t {
 #define FS_RENAME_DOES_D_MOVE	32768	/* FS will handle d_move()
 					 * during rename() internally.
 					 */
+#define FS_RCU_INODES	65536	/* ->destroy_inode() frees the inode
+					 * after an RCU grace period, so
+					 * path walking may look at it
+					 * under rcu_read_lock().
+					 */
+#define FS_PARALLEL_DIROPS 131072	/* Directories live entirely in the
+					 * dcache (no ->d_hash, no
+					 * ->d_revalidate) and ->create and
+					 * ->unlink may run concurrently in
+					 * one directory for distinct names.
+					 * ->unlink must not fail.
+					 */
 
 /*
  * These are the fs-independent mount-flags: up to 32 flags are supported
@@ -416,6 +440,8 @@ extern struct files_stat_struct files_stat;
 extern unsigned long get_max_files(void);
 extern int sysctl_nr_open;
 extern struct inodes_stat_t inodes_stat;
+extern struct path_walk_stat_t path_walk_stat;
+extern int sysctl_fput_defer_max;
 extern int leases_enable, lease_break_time;
 
 struct buffer_head;
@@ -734,10 +760,14 @@ struct posix_acl;
 
 struct inode {
 	struct hlist_node	i_hash;
+	struct inode_hash_bucket *i_hash_bucket; /* locks i_hash */
 	struct list_head	i_wb_list;	/* backing dev IO list */
 	struct list_head	i_lru;		/* inode LRU list */
 	struct list_head	i_sb_list;
-	struct list_head	i_dentry;
+	union {
+		struct list_head	i_dentry;
+		struct rcu_head		i_rcu;	/* see FS_RCU_INODES */
+	};
 	unsigned long		i_ino;
 	atomic_t		i_count;
 	unsigned int		i_nlink;
@@ -928,8 +958,8 @@ static inline int ra_has_index(struct file_ra_state *ra, pgoff_t index)
 
 struct file {
 	/*
-	 * fu_list becomes invalid after file_free is called and queued via
-	 * fu_rcuhead for RCU freeing
+	 * fu_list is only used by deferred fput, after the last reference
+	 * is gone and before file_free queues fu_rcuhead for RCU freeing
 	 */
 	union {
 		struct list_head	fu_list;
@@ -940,9 +970,6 @@ struct file {
 #define f_vfsmnt	f_path.mnt
 	const struct file_operations	*f_op;
 	spinlock_t		f_lock;  /* f_ep_links, f_flags, no IRQ */
-#ifdef CONFIG_SMP
-	int			f_sb_list_cpu;
-#endif
 	atomic_long_t		f_count;
 	unsigned int 		f_flags;
 	fmode_t			f_mode;
@@ -1371,14 +1398,13 @@ struct super_block {
 #endif
 	const struct xattr_handler **s_xattr;
 
+	spinlock_t		s_inodes_lock;	/* protects s_inodes */
 	struct list_head	s_inodes;	/* all inodes */
 	struct hlist_head	s_anon;		/* anonymous dentries for (nfs) exporting */
-#ifdef CONFIG_SMP
-	struct list_head __percpu *s_files;
-#else
-	struct list_head	s_files;
-#endif
-	/* s_dentry_lru and s_nr_dentry_unused are protected by dcache_lock */
+	struct list_head	s_mounts;	/* vfsmounts; vfsmount_lock */
+	int			s_readonly_remount; /* refuse new writers */
+	/* s_dentry_lru and s_nr_dentry_unused are protected by s_dentry_lru_lock */
+	spinlock_t		s_dentry_lru_lock;
 	struct list_head	s_dentry_lru;	/* unused dentry lru */
 	int			s_nr_dentry_unused;	/* # of dentry on lru */
 
@@ -1616,7 +1642,7 @@ struct super_operations {
 };
 
 /*
- * Inode state bits.  Protected by inode_lock.
+ * Inode state bits.  Protected by inode->i_lock.
  *
  * Three bits determine the dirty state of the inode, I_DIRTY_SYNC,
  * I_DIRTY_DATASYNC and I_DIRTY_PAGES.
@@ -1850,6 +1876,7 @@ extern int register_filesystem(struct file_system_type *);
 extern int unregister_filesystem(struct file_system_type *);
 extern struct vfsmount *kern_mount_data(struct file_system_type *, void *data);
 #define kern_mount(type) kern_mount_data(type, NULL)
+extern void kern_unmount(struct vfsmount *mnt);
 extern int may_umount_tree(struct vfsmount *);
 extern int may_umount(struct vfsmount *);
 extern long do_mount(char *, char *, char *, unsigned long, void *);
@@ -2100,8 +2127,6 @@ extern const struct file_operations read_pipefifo_fops;
 extern const struct file_operations write_pipefifo_fops;
 extern const struct file_operations rdwr_pipefifo_fops;
 
-extern int fs_may_remount_ro(struct super_block *);
-
 #ifdef CONFIG_BLOCK
 /*
  * return READ, READA, or WRITE
@@ -2288,6 +2313,8 @@ file_ra_state_init(struct file_ra_state *ra, struct address_space *mapping);
 extern loff_t noop_llseek(struct file *file, loff_t offset, int origin);
 extern loff_t no_llseek(struct file *file, loff_t offset, int origin);
 extern loff_t generic_file_llseek(struct file *file, loff_t offset, int origin);
+extern loff_t generic_file_llseek_size(struct file *file, loff_t offset,
+		int origin, loff_t maxsize);
 extern loff_t generic_file_llseek_unlocked(struct file *file, loff_t offset,
 			int origin);
 extern int generic_file_open(struct inode * inode, struct file * filp);
@@ -2526,6 +2553,10 @@ int proc_nr_dentry(struct ctl_table *table, int write,
 		  void __user *buffer, size_t *lenp, loff_t *ppos);
 int proc_nr_inodes(struct ctl_table *table, int write,
 		   void __user *buffer, size_t *lenp, loff_t *ppos);
+int proc_path_walk_state(struct ctl_table *table, int write,
+			 void __user *buffer, size_t *lenp, loff_t *ppos);
+int proc_fput_defer_state(struct ctl_table *table, int write,
+			  void __user *buffer, size_t *lenp, loff_t *ppos);
 int __init get_filesystem_list(char *buf);
 
 #define ACC_MODE(x) ("\004\002\006\006"[(x)&O_ACCMODE])
@@ -182,6 +182,21 @@ static inline void clear_highpage(struct page *page)
 	kunmap_atomic(kaddr, KM_USER0);
 }
 
+#ifndef __HAVE_ARCH_CLEAR_PAGE_NOCACHE
+#define clear_page_nocache(page)	clear_page(page)
+#endif
+
+/*
+ * Zero a page that will not be used for a while, bypassing the cache
+ * where the architecture can.
+ */
+static inline void clear_highpage_nocache(struct page *page)
+{
+	void *kaddr = kmap_atomic(page, KM_USER0);
+	clear_page_nocache(kaddr);
+	kunmap_atomic(kaddr, KM_USER0);
+}
+
 static inline void zero_user_segments(struct page *page,
 	unsigned start1, unsigned end1,
 	unsigned start2, unsigned end2)
@@ -0,0 +1,149 @@
+#ifndef _LINUX_HUGE_MM_H
+#define _LINUX_HUGE_MM_H
+
+/*
+ * Transparent huge pages: anonymous memory mapped by a pmd.
+ *
+ * A huge pmd maps HPAGE_PMD_NR naturally aligned, physically contiguous
+ * small pages.  They are ordinary pages - each has its own count,
+ * mapcount, anon rmap and LRU position - so the only thing special
+ * about them is the pmd.  Code that cannot handle a huge pmd splits it
+ * into a page table mapping the same pages with split_huge_pmd(),
+ * which only needs mm->page_table_lock and never fails: every huge pmd
+ * has a page table deposited for it.
+ *
+ * A huge pmd is always entirely inside one vma, and only ever installed
+ * over pmd_none(): so under mmap_sem, a pmd that maps a page table keeps
+ * mapping one.  khugepaged, which turns page tables back into huge
+ * pmds, holds mmap_sem for writing.
+ */
+
+extern int do_huge_pmd_anonymous_page(struct mm_struct *mm,
+				      struct vm_area_struct *vma,
+				      unsigned long address, pmd_t *pmd,
+				      unsigned int flags);
+extern int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
+			 pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
+			 struct vm_area_struct *vma);
+extern int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			       unsigned long address, pmd_t *pmd,
+			       pmd_t orig_pmd);
+extern struct page *follow_trans_huge_pmd(struct vm_area_struct *vma,
+					  unsigned long addr, pmd_t *pmd,
+					  unsigned int flags);
+extern int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
+			pmd_t *pmd, unsigned long addr);
+extern int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+			   unsigned long addr, pgprot_t newprot);
+
+enum transparent_hugepage_flag {
+	TRANSPARENT_HUGEPAGE_FLAG,
+	TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+	TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+	TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG,
+	TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG,
+};
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define HPAGE_PMD_SHIFT PMD_SHIFT
+#define HPAGE_PMD_SIZE	((1UL) << HPAGE_PMD_SHIFT)
+#define HPAGE_PMD_MASK	(~(HPAGE_PMD_SIZE - 1))
+#define HPAGE_PMD_ORDER (HPAGE_PMD_SHIFT - PAGE_SHIFT)
+#define HPAGE_PMD_NR	(1 << HPAGE_PMD_ORDER)
+
+extern unsigned long transparent_hugepage_flags;
+
+/* vmas that can never be mapped with huge pmds */
+#define VM_NO_THP	(VM_SPECIAL | VM_INSERTPAGE | VM_MIXEDMAP | \
+			 VM_HUGETLB | VM_SHARED | VM_MAYSHARE | \
+			 VM_GROWSDOWN | VM_GROWSUP)
+
+#define transparent_hugepage_enabled(__vma)				\
+	((transparent_hugepage_flags &					\
+	  (1<<TRANSPARENT_HUGEPAGE_FLAG) ||				\
+	  (transparent_hugepage_flags &					\
+	   (1<<TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG) &&			\
+	   ((__vma)->vm_flags & VM_HUGEPAGE))) &&			\
+	 !((__vma)->vm_flags & (VM_NOHUGEPAGE | VM_NO_THP)) &&		\
+	 !(__vma)->vm_ops)
+#define transparent_hugepage_defrag(__vma)				\
+	((transparent_hugepage_flags &					\
+	  (1<<TRANSPARENT_HUGEPAGE_DEFRAG_FLAG)) ||			\
+	 (transparent_hugepage_flags &					\
+	  (1<<TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG) &&		\
+	  (__vma)->vm_flags & VM_HUGEPAGE))
+
+extern void __split_huge_pmd(struct mm_struct *mm, pmd_t *pmd,
+			     unsigned long address);
+static inline void split_huge_pmd(struct mm_struct *mm, pmd_t *pmd,
+				  unsigned long address)
+{
+	if (unlikely(pmd_trans_huge(*pmd)))
+		__split_huge_pmd(mm, pmd, address);
+}
+
+extern int split_huge_pmd_page(struct mm_struct *mm, pmd_t *pmd,
+			       unsigned long address, struct page *page);
+extern int huge_pmd_referenced(struct page *page, struct vm_area_struct *vma,
+			       unsigned long address, unsigned int *mapcount,
+			       unsigned long *vm_flags);
+
+extern void __vma_adjust_trans_huge(struct vm_area_struct *vma,
+				    unsigned long start, unsigned long end,
+				    long adjust_next);
+static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
+					 unsigned long start,
+					 unsigned long end,
+					 long adjust_next)
+{
+	if (!vma->anon_vma || vma->vm_ops)
+		return;
+	__vma_adjust_trans_huge(vma, start, end, adjust_next);
+}
+
+extern int hugepage_madvise(struct vm_area_struct *vma,
+			    unsigned long *vm_flags, int advice);
+#else /* CONFIG_TRANSPARENT_HUGEPAGE */
+#define HPAGE_PMD_SHIFT ({ BUG(); 0; })
+#define HPAGE_PMD_MASK ({ BUG(); 0; })
+#define HPAGE_PMD_SIZE ({ BUG(); 0; })
+#define HPAGE_PMD_NR ({ BUG(); 0; })
+
+#define transparent_hugepage_enabled(__vma) 0
+
+static inline void split_huge_pmd(struct mm_struct *mm, pmd_t *pmd,
+				  unsigned long address)
+{
+}
+
+static inline int split_huge_pmd_page(struct mm_struct *mm, pmd_t *pmd,
+				      unsigned long address, struct page *page)
+{
+	return 1;
+}
+
+static inline int huge_pmd_referenced(struct page *page,
+				      struct vm_area_struct *vma,
+				      unsigned long address,
+				      unsigned int *mapcount,
+				      unsigned long *vm_flags)
+{
+	return -1;
+}
+
+static inline void vma_adjust_trans_huge(struct vm_area_struct *vma,
+					 unsigned long start,
+					 unsigned long end,
+					 long adjust_next)
+{
+}
+
+static inline int hugepage_madvise(struct vm_area_struct *vma,
+				   unsigned long *vm_flags, int advice)
+{
+	BUG();
+	return 0;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+#endif /* _LINUX_HUGE_MM_H */
@@ -32,6 +32,7 @@ extern int page_cluster;
 
 #ifdef CONFIG_SYSCTL
 extern int sysctl_legacy_va_layout;
+extern unsigned long sysctl_fault_around_bytes;
 #else
 #define sysctl_legacy_va_layout 0
 #endif
@@ -111,6 +112,12 @@ extern unsigned int kobjsize(const void *objp);
 #define VM_PFN_AT_MMAP	0x40000000	/* PFNMAP vma that is fully mapped at mmap time */
 #define VM_MERGEABLE	0x80000000	/* KSM may merge identical pages */
 
+/* The low 32 bits are all taken: these only exist with a 64-bit vm_flags */
+#ifdef CONFIG_64BIT
+#define VM_HUGEPAGE	0x100000000UL	/* MADV_HUGEPAGE marked this vma */
+#define VM_NOHUGEPAGE	0x200000000UL	/* MADV_NOHUGEPAGE marked this vma */
+#endif
+
 /* Bits set in the VMA until the stack is in its final location */
 #define VM_STACK_INCOMPLETE_SETUP	(VM_RAND_READ | VM_SEQ_READ)
 
@@ -183,6 +190,9 @@ struct vm_fault {
 					 * is set (which is also implied by
 					 * VM_FAULT_ERROR).
 					 */
+	/* for ->map_pages() only */
+	pgoff_t max_pgoff;		/* Map pages up to this offset */
+	pte_t *pte;			/* pte entry for pgoff */
 };
 
 /*
@@ -195,6 +205,11 @@ struct vm_operations_struct {
 	void (*close)(struct vm_area_struct * area);
 	int (*fault)(struct vm_area_struct *vma, struct vm_fault *vmf);
 
+	/* map pages already in the page cache around a read fault, without
+	 * sleeping; called with the page table lock held.  Returns the
+	 * number of ptes it filled in. */
+	int (*map_pages)(struct vm_area_struct *vma, struct vm_fault *vmf);
+
 	/* notification that a previously read-only page is about to become
 	 * writable, if an error is returned it will cause a SIGBUS */
 	int (*page_mkwrite)(struct vm_area_struct *vma, struct vm_fault *vmf);
@@ -599,6 +614,8 @@ static inline void set_page_links(struct page *page, enum zone_type zone,
  */
 #include <linux/vmstat.h>
 
+#include <linux/huge_mm.h>
+
 static __always_inline void *lowmem_page_address(struct page *page)
 {
 	return __va(PFN_PHYS(page_to_pfn(page)));
@@ -725,6 +742,7 @@ static inline int page_mapped(struct page *page)
 #define VM_FAULT_NOPAGE	0x0100	/* ->fault installed the pte, not return page */
 #define VM_FAULT_LOCKED	0x0200	/* ->fault locked the returned page */
 #define VM_FAULT_RETRY	0x0400	/* ->fault blocked, must retry */
+#define VM_FAULT_FALLBACK 0x0800	/* huge page fault failed, fall back to small */
 
 #define VM_FAULT_HWPOISON_LARGE_MASK 0xf000 /* encodes hpage index for large hwpoison */
 
@@ -789,6 +807,10 @@ unsigned long unmap_vmas(struct mmu_gather **tlb,
  * @pgd_entry: if set, called for each non-empty PGD (top-level) entry
  * @pud_entry: if set, called for each non-empty PUD (2nd-level) entry
  * @pmd_entry: if set, called for each non-empty PMD (3rd-level) entry
+ * @pmd_huge_entry: if set, called for each transparent huge PMD entry;
+ *		    returns > 0 if the PMD was split meanwhile and should
+ *		    be walked as a page table.  If not set, huge PMDs are
+ *		    split.
  * @pte_entry: if set, called for each non-empty PTE (4th-level) entry
  * @pte_hole: if set, called for each hole at all levels
  * @hugetlb_entry: if set, called for each hugetlb entry
@@ -799,6 +821,8 @@ struct mm_walk {
 	int (*pgd_entry)(pgd_t *, unsigned long, unsigned long, struct mm_walk *);
 	int (*pud_entry)(pud_t *, unsigned long, unsigned long, struct mm_walk *);
 	int (*pmd_entry)(pmd_t *, unsigned long, unsigned long, struct mm_walk *);
+	int (*pmd_huge_entry)(pmd_t *, unsigned long, unsigned long,
+			      struct mm_walk *);
 	int (*pte_entry)(pte_t *, unsigned long, unsigned long, struct mm_walk *);
 	int (*pte_hole)(unsigned long, unsigned long, struct mm_walk *);
 	int (*hugetlb_entry)(pte_t *, unsigned long,
@@ -852,6 +876,59 @@ static inline int handle_mm_fault(struct mm_struct *mm,
 }
 #endif
 
+/*
+ * Writers that change a vma the speculative fault path may be looking
+ * at, the vma rbtree, or move ptes from one vma to another, bracket the
+ * change with these.  They all hold mmap_sem for write already.
+ */
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags);
+
+static inline void vma_write_begin(struct vm_area_struct *vma)
+{
+	write_seqcount_begin(&vma->vm_sequence);
+}
+
+static inline void vma_write_end(struct vm_area_struct *vma)
+{
+	write_seqcount_end(&vma->vm_sequence);
+}
+
+static inline void mm_rb_write_begin(struct mm_struct *mm)
+{
+	write_seqcount_begin(&mm->mm_rb_seq);
+}
+
+static inline void mm_rb_write_end(struct mm_struct *mm)
+{
+	write_seqcount_end(&mm->mm_rb_seq);
+}
+
+static inline void mm_move_ptes_begin(struct mm_struct *mm)
+{
+	write_seqcount_begin(&mm->mm_seq);
+}
+
+static inline void mm_move_ptes_end(struct mm_struct *mm)
+{
+	write_seqcount_end(&mm->mm_seq);
+}
+#else
+static inline int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags)
+{
+	return VM_FAULT_RETRY;
+}
+
+static inline void vma_write_begin(struct vm_area_struct *vma) { }
+static inline void vma_write_end(struct vm_area_struct *vma) { }
+static inline void mm_rb_write_begin(struct mm_struct *mm) { }
+static inline void mm_rb_write_end(struct mm_struct *mm) { }
+static inline void mm_move_ptes_begin(struct mm_struct *mm) { }
+static inline void mm_move_ptes_end(struct mm_struct *mm) { }
+#endif
+
 extern int make_pages_present(unsigned long addr, unsigned long end);
 extern int access_process_vm(struct task_struct *tsk, unsigned long addr, void *buf, int len, int write);
 
@@ -1329,6 +1406,9 @@ extern void truncate_inode_pages_range(struct address_space *,
 
 /* generic vm_area_ops exported for stackable file systems */
 extern int filemap_fault(struct vm_area_struct *, struct vm_fault *);
+extern int filemap_map_pages(struct vm_area_struct *, struct vm_fault *);
+extern void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		       struct page *page, pte_t *pte);
 
 /* mm/page-writeback.c */
 int write_one_page(struct page *page, int wait);
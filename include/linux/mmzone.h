@@ -106,6 +106,7 @@ enum zone_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
+	NR_ANON_TRANSPARENT_HUGEPAGES,	/* huge pmds mapping anon pages */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -175,6 +176,13 @@ struct per_cpu_pages {
 
 	/* Lists of pages, one per migrate type stored on the pcp-lists */
 	struct list_head lists[MIGRATE_PCPTYPES];
+
+	/* Autotuning of high and batch, see pcp_autotune() */
+	int high_base;		/* high before autotuning, 0 if fixed */
+	int batch_base;		/* batch before autotuning */
+	int shift;		/* high and batch are base << shift */
+	unsigned int refills;	/* list refills from buddy since last tune */
+	unsigned int drains;	/* list spills to buddy since last tune */
 };
 
 struct per_cpu_pageset {
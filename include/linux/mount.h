@@ -13,6 +13,7 @@
 #include <linux/list.h>
 #include <linux/nodemask.h>
 #include <linux/spinlock.h>
+#include <linux/percpu_refcount.h>
 #include <asm/atomic.h>
 
 struct super_block;
@@ -68,14 +69,21 @@ struct vfsmount {
 	struct list_head mnt_slave;	/* slave list entry */
 	struct vfsmount *mnt_master;	/* slave is on master->mnt_slave_list */
 	struct mnt_namespace *mnt_ns;	/* containing namespace */
+	struct list_head mnt_instance;	/* link in sb->s_mounts */
 	int mnt_id;			/* mount identifier */
 	int mnt_group_id;		/* peer group identifier */
 	/*
 	 * We put mnt_count & mnt_expiry_mark at the end of struct vfsmount
 	 * to let these frequently modified fields in a separate cache line
 	 * (so that reads of mnt_flags wont ping-pong on SMP machines)
+	 *
+	 * mnt_count is distributed over the CPUs.  While mnt_longterm is
+	 * non-zero the mount cannot go away, and references are dropped on
+	 * the local CPU only; otherwise mntput() sums the count under
+	 * vfsmount_lock held for write.
 	 */
-	atomic_t mnt_count;
+	struct percpu_refcount mnt_count;
+	atomic_t mnt_longterm;		/* long-term users: namespaces, kernel */
 	int mnt_expiry_mark;		/* true if marked for expiry */
 	int mnt_pinned;
 	int mnt_ghosts;
@@ -98,7 +106,7 @@ static inline int *get_mnt_writers_ptr(struct vfsmount *mnt)
 static inline struct vfsmount *mntget(struct vfsmount *mnt)
 {
 	if (mnt)
-		atomic_inc(&mnt->mnt_count);
+		percpu_refcount_inc(&mnt->mnt_count);
 	return mnt;
 }
 
@@ -109,6 +117,8 @@ extern int mnt_want_write_file(struct file *file);
 extern int mnt_clone_write(struct vfsmount *mnt);
 extern void mnt_drop_write(struct vfsmount *mnt);
 extern void mntput_no_expire(struct vfsmount *mnt);
+extern void mnt_make_longterm(struct vfsmount *mnt);
+extern void mnt_make_shortterm(struct vfsmount *mnt);
 extern void mnt_pin(struct vfsmount *mnt);
 extern void mnt_unpin(struct vfsmount *mnt);
 extern int __mnt_is_readonly(struct vfsmount *mnt);
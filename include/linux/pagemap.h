@@ -202,11 +202,19 @@ static inline void page_unfreeze_refs(struct page *page, int count)
 
 #ifdef CONFIG_NUMA
 extern struct page *__page_cache_alloc(gfp_t gfp);
+extern unsigned long __page_cache_alloc_bulk(gfp_t gfp,
+		unsigned long nr_pages, struct list_head *list);
 #else
 static inline struct page *__page_cache_alloc(gfp_t gfp)
 {
 	return alloc_pages(gfp, 0);
 }
+
+static inline unsigned long __page_cache_alloc_bulk(gfp_t gfp,
+		unsigned long nr_pages, struct list_head *list)
+{
+	return alloc_pages_bulk_list(gfp, nr_pages, list);
+}
 #endif
 
 static inline struct page *page_cache_alloc(struct address_space *x)
@@ -455,6 +463,9 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 				pgoff_t index, gfp_t gfp_mask);
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t index, gfp_t gfp_mask);
+struct pagevec;
+unsigned pagevec_add_to_page_cache_lru(struct pagevec *pvec,
+				struct address_space *mapping, gfp_t gfp_mask);
 extern void remove_from_page_cache(struct page *page);
 extern void __remove_from_page_cache(struct page *page);
 
@@ -0,0 +1,44 @@
+#ifndef _LINUX_PERCPU_REFCOUNT_H
+#define _LINUX_PERCPU_REFCOUNT_H
+/*
+ * Distributed ("sloppy") reference counts.
+ *
+ * Each CPU keeps its own count and gets and puts only touch the local
+ * CPU's slot, so an object referenced from many CPUs at once does not
+ * bounce a cache line between them.  A single slot may go negative: only
+ * the sum over all CPUs is meaningful.
+ *
+ * The sum is only exact while nobody else can change the count, and it
+ * is the owner's job to guarantee that before testing for zero.  The
+ * usual scheme is for the owner to hold a long-term reference that keeps
+ * the count from reaching zero, drop ordinary references with a plain
+ * percpu_refcount_dec() while it is held, and fall back to a lock which
+ * excludes all other users once it is gone (see mntput_no_expire()).
+ */
+
+#include <linux/percpu.h>
+
+struct percpu_refcount {
+	int __percpu *count;
+};
+
+extern int percpu_refcount_init(struct percpu_refcount *ref, int count);
+extern void percpu_refcount_destroy(struct percpu_refcount *ref);
+extern int percpu_refcount_sum(struct percpu_refcount *ref);
+
+static inline void percpu_refcount_add(struct percpu_refcount *ref, int nr)
+{
+	this_cpu_add(*ref->count, nr);
+}
+
+static inline void percpu_refcount_inc(struct percpu_refcount *ref)
+{
+	this_cpu_inc(*ref->count);
+}
+
+static inline void percpu_refcount_dec(struct percpu_refcount *ref)
+{
+	this_cpu_dec(*ref->count);
+}
+
+#endif /* _LINUX_PERCPU_REFCOUNT_H */
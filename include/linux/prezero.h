@@ -0,0 +1,21 @@
+#ifndef _LINUX_PREZERO_H
+#define _LINUX_PREZERO_H
+
+struct ctl_table;
+struct vm_area_struct;
+struct page;
+
+#ifdef CONFIG_PREZERO_PAGES
+extern unsigned long sysctl_prezero_pages;
+extern int prezero_sysctl_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos);
+
+extern struct page *prezero_alloc_page(struct vm_area_struct *vma);
+#else
+static inline struct page *prezero_alloc_page(struct vm_area_struct *vma)
+{
+	return NULL;
+}
+#endif
+
+#endif /* _LINUX_PREZERO_H */
@@ -26,7 +26,12 @@
  */
 struct anon_vma {
 	struct anon_vma *root;	/* Root of this anon_vma tree */
-	spinlock_t lock;	/* Serialize access to vma list */
+	/*
+	 * Serialize access to vma list.  Only the root's rwlock is ever
+	 * taken, for the whole tree: for writing to link or unlink vmas,
+	 * for reading to walk the list (page_referenced, try_to_unmap).
+	 */
+	rwlock_t rwlock;
 #if defined(CONFIG_KSM) || defined(CONFIG_MIGRATION)
 
 	/*
@@ -67,7 +72,7 @@ struct anon_vma_chain {
 	struct vm_area_struct *vma;
 	struct anon_vma *anon_vma;
 	struct list_head same_vma;   /* locked by mmap_sem & page_table_lock */
-	struct list_head same_anon_vma;	/* locked by anon_vma->lock */
+	struct list_head same_anon_vma;	/* locked by anon_vma->rwlock */
 };
 
 #ifdef CONFIG_MMU
@@ -119,24 +124,35 @@ static inline void vma_lock_anon_vma(struct vm_area_struct *vma)
 {
 	struct anon_vma *anon_vma = vma->anon_vma;
 	if (anon_vma)
-		spin_lock(&anon_vma->root->lock);
+		write_lock(&anon_vma->root->rwlock);
 }
 
 static inline void vma_unlock_anon_vma(struct vm_area_struct *vma)
 {
 	struct anon_vma *anon_vma = vma->anon_vma;
 	if (anon_vma)
-		spin_unlock(&anon_vma->root->lock);
+		write_unlock(&anon_vma->root->rwlock);
 }
 
 static inline void anon_vma_lock(struct anon_vma *anon_vma)
 {
-	spin_lock(&anon_vma->root->lock);
+	write_lock(&anon_vma->root->rwlock);
 }
 
 static inline void anon_vma_unlock(struct anon_vma *anon_vma)
 {
-	spin_unlock(&anon_vma->root->lock);
+	write_unlock(&anon_vma->root->rwlock);
+}
+
+/* for walking the vma list without changing it */
+static inline void anon_vma_lock_read(struct anon_vma *anon_vma)
+{
+	read_lock(&anon_vma->root->rwlock);
+}
+
+static inline void anon_vma_unlock_read(struct anon_vma *anon_vma)
+{
+	read_unlock(&anon_vma->root->rwlock);
 }
 
 /*
@@ -250,7 +266,7 @@ static inline struct anon_vma *page_lock_anon_vma(struct page *page)
 	__cond_lock(RCU, anon_vma = __page_lock_anon_vma(page));
 
 	/* (void) is needed to make gcc happy */
-	(void) __cond_lock(&anon_vma->root->lock, anon_vma);
+	(void) __cond_lock(&anon_vma->root->rwlock, anon_vma);
 
 	return anon_vma;
 }
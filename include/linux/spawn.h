@@ -0,0 +1,26 @@
+#ifndef _LINUX_SPAWN_H
+#define _LINUX_SPAWN_H
+
+#include <linux/types.h>
+
+/*
+ * File actions for spawn(2), run in order in the new process before the
+ * exec, like posix_spawn_file_actions_add{close,dup2,open}().
+ */
+#define SPAWN_ACTION_CLOSE	1	/* close(fd) */
+#define SPAWN_ACTION_DUP2	2	/* dup2(srcfd, fd) */
+#define SPAWN_ACTION_OPEN	3	/* open(path, flags, mode) as fd */
+
+#define SPAWN_ACTIONS_MAX	256
+
+struct spawn_action {
+	__u32 type;		/* SPAWN_ACTION_* */
+	__s32 fd;		/* descriptor the action applies to */
+	__s32 srcfd;		/* DUP2: descriptor to duplicate */
+	__u32 flags;		/* OPEN: open flags */
+	__u32 mode;		/* OPEN: creation mode */
+	__u32 reserved;		/* must be zero */
+	__u64 path;		/* OPEN: const char __user * */
+};
+
+#endif /* _LINUX_SPAWN_H */
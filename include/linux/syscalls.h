@@ -36,6 +36,7 @@ struct old_utsname;
 struct pollfd;
 struct rlimit;
 struct rlimit64;
+struct spawn_action;
 struct rusage;
 struct sched_param;
 struct sel_arg_struct;
@@ -648,6 +649,11 @@ asmlinkage long sys_setrlimit(unsigned int resource,
 asmlinkage long sys_prlimit64(pid_t pid, unsigned int resource,
 				const struct rlimit64 __user *new_rlim,
 				struct rlimit64 __user *old_rlim);
+asmlinkage long sys_spawn(const char __user *filename,
+				const char __user *const __user *argv,
+				const char __user *const __user *envp,
+				const struct spawn_action __user *actions,
+				unsigned int nr_actions, unsigned int flags);
 asmlinkage long sys_getrusage(int who, struct rusage __user *ru);
 asmlinkage long sys_umask(int mask);
 
@@ -0,0 +1,42 @@
+#ifndef __LINUX_VMACACHE_H
+#define __LINUX_VMACACHE_H
+
+#include <linux/sched.h>
+#include <linux/mm.h>
+
+/*
+ * Per-thread cache of recently looked up vmas, so that threads working
+ * in different parts of one address space do not fight over a single
+ * shared slot.  The entries of a thread are only trusted while its
+ * vmacache_seqnum matches the mm's, which is bumped whenever a vma
+ * leaves the tree.
+ */
+#define VMACACHE_HASH(addr) ((addr >> PAGE_SHIFT) & VMACACHE_MASK)
+
+static inline void vmacache_flush(struct task_struct *tsk)
+{
+	memset(tsk->vmacache, 0, sizeof(tsk->vmacache));
+}
+
+/*
+ * Called with mmap_sem held for write once the vma is out of mm_rb, but
+ * still inside the mm_rb_seq write section: a speculative lookup that
+ * already sees the new seqnum must also see the tree change, or it
+ * could cache the vma being removed under the up to date seqnum.
+ */
+static inline void vmacache_invalidate(struct mm_struct *mm)
+{
+	mm->vmacache_seqnum++;
+}
+
+extern void vmacache_update(unsigned long addr, struct vm_area_struct *newvma);
+extern struct vm_area_struct *vmacache_find(struct mm_struct *mm,
+					    unsigned long addr);
+
+#ifndef CONFIG_MMU
+extern struct vm_area_struct *vmacache_find_exact(struct mm_struct *mm,
+						  unsigned long start,
+						  unsigned long end);
+#endif
+
+#endif /* __LINUX_VMACACHE_H */
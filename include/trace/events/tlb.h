@@ -0,0 +1,47 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tlb
+
+#if !defined(_TRACE_TLB_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_TLB_H
+
+#include <linux/mm_types.h>
+#include <linux/cpumask.h>
+#include <linux/tracepoint.h>
+
+/*
+ * One remote TLB shootdown of @mm: how many cpus got the flush IPI, and
+ * how many were in lazy tlb mode and were only marked for a flush when
+ * they switch back to the mm.  end == -1 flushes the whole mm.
+ */
+TRACE_EVENT(tlb_flush_ipi,
+
+	TP_PROTO(struct mm_struct *mm, unsigned long start, unsigned long end,
+		 const struct cpumask *ipi_mask, unsigned int nr_lazy),
+
+	TP_ARGS(mm, start, end, ipi_mask, nr_lazy),
+
+	TP_STRUCT__entry(
+		__field(	struct mm_struct *,	mm	)
+		__field(	unsigned long,		start	)
+		__field(	unsigned long,		end	)
+		__field(	unsigned int,		nr_ipi	)
+		__field(	unsigned int,		nr_lazy	)
+	),
+
+	TP_fast_assign(
+		__entry->mm	= mm;
+		__entry->start	= start;
+		__entry->end	= end;
+		__entry->nr_ipi	= cpumask_weight(ipi_mask);
+		__entry->nr_lazy = nr_lazy;
+	),
+
+	TP_printk("mm=%p start=%lx end=%lx nr_ipi=%u nr_lazy=%u",
+		__entry->mm, __entry->start, __entry->end,
+		__entry->nr_ipi, __entry->nr_lazy)
+);
+
+#endif /* _TRACE_TLB_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
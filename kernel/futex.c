@@ -59,6 +59,9 @@
 #include <linux/magic.h>
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
+#include <linux/bootmem.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/futex.h>
 
@@ -66,8 +69,6 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
-
 /*
  * Priority Inheritance state:
  */
@@ -131,9 +132,17 @@ struct futex_q {
 struct futex_hash_bucket {
 	spinlock_t lock;
 	struct plist_head chain;
-};
+	unsigned long contended;	/* under lock; see hb_lock() */
+} ____cacheline_aligned_in_smp;
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+/*
+ * The hash is sized at boot, 256 buckets per possible cpu, and on NUMA
+ * spread over all the nodes (see hashdist): tasks on every node wait on
+ * futexes, and a fixed size table made unrelated futexes share buckets,
+ * and bucket locks, as soon as there were enough threads.
+ */
+static struct futex_hash_bucket *futex_queues;
+static unsigned int futex_hashmask;
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
@@ -143,7 +152,27 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+	return &futex_queues[hash & futex_hashmask];
+}
+
+/*
+ * Take a bucket lock, counting in the bucket how often it was found
+ * taken already.  The counts are shown in debugfs as futex_hash.
+ */
+static inline void hb_lock(struct futex_hash_bucket *hb)
+{
+	if (unlikely(!spin_trylock(&hb->lock))) {
+		spin_lock(&hb->lock);
+		hb->contended++;
+	}
+}
+
+static inline void hb_lock_nested(struct futex_hash_bucket *hb, int subclass)
+{
+	if (unlikely(!spin_trylock(&hb->lock))) {
+		spin_lock_nested(&hb->lock, subclass);
+		hb->contended++;
+	}
 }
 
 /*
@@ -469,7 +498,7 @@ void exit_pi_state_list(struct task_struct *curr)
 		hb = hash_futex(&key);
 		raw_spin_unlock_irq(&curr->pi_lock);
 
-		spin_lock(&hb->lock);
+		hb_lock(hb);
 
 		raw_spin_lock_irq(&curr->pi_lock);
 		/*
@@ -850,12 +879,12 @@ static inline void
 double_lock_hb(struct futex_hash_bucket *hb1, struct futex_hash_bucket *hb2)
 {
 	if (hb1 <= hb2) {
-		spin_lock(&hb1->lock);
+		hb_lock(hb1);
 		if (hb1 < hb2)
-			spin_lock_nested(&hb2->lock, SINGLE_DEPTH_NESTING);
+			hb_lock_nested(hb2, SINGLE_DEPTH_NESTING);
 	} else { /* hb1 > hb2 */
-		spin_lock(&hb2->lock);
-		spin_lock_nested(&hb1->lock, SINGLE_DEPTH_NESTING);
+		hb_lock(hb2);
+		hb_lock_nested(hb1, SINGLE_DEPTH_NESTING);
 	}
 }
 
@@ -886,7 +915,7 @@ static int futex_wake(u32 __user *uaddr, int fshared, int nr_wake, u32 bitset)
 		goto out;
 
 	hb = hash_futex(&key);
-	spin_lock(&hb->lock);
+	hb_lock(hb);
 	head = &hb->chain;
 
 	plist_for_each_entry_safe(this, next, head, list) {
@@ -1370,7 +1399,7 @@ static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
 	hb = hash_futex(&q->key);
 	q->lock_ptr = &hb->lock;
 
-	spin_lock(&hb->lock);
+	hb_lock(hb);
 	return hb;
 }
 
@@ -2043,7 +2072,7 @@ retry:
 		goto out;
 
 	hb = hash_futex(&key);
-	spin_lock(&hb->lock);
+	hb_lock(hb);
 
 	/*
 	 * To avoid races, try to do the TID -> 0 atomic transition
@@ -2250,7 +2279,7 @@ static int futex_wait_requeue_pi(u32 __user *uaddr, int fshared,
 	/* Queue the futex_q, drop the hb lock, wait for wakeup. */
 	futex_wait_queue_me(hb, &q, to);
 
-	spin_lock(&hb->lock);
+	hb_lock(hb);
 	ret = handle_early_requeue_pi_wakeup(hb, &q, &key2, to);
 	spin_unlock(&hb->lock);
 	if (ret)
@@ -2646,6 +2675,7 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 static int __init futex_init(void)
 {
+	unsigned long futex_hashsize;
 	u32 curval;
 	int i;
 
@@ -2663,11 +2693,94 @@ static int __init futex_init(void)
 	if (curval == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
+#if CONFIG_BASE_SMALL
+	futex_hashsize = 16;
+#else
+	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+#endif
+	futex_queues = alloc_large_system_hash("futex",
+					       sizeof(*futex_queues),
+					       futex_hashsize, 0, 0,
+					       NULL, &futex_hashmask,
+					       futex_hashsize);
+	futex_hashsize = futex_hashmask + 1;
+
+	for (i = 0; i < futex_hashsize; i++) {
 		plist_head_init(&futex_queues[i].chain, &futex_queues[i].lock);
 		spin_lock_init(&futex_queues[i].lock);
+		futex_queues[i].contended = 0;
 	}
 
 	return 0;
 }
 __initcall(futex_init);
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * One line per bucket that was ever found locked: its index, how many
+ * times, and how many tasks are queued on it now.
+ */
+static void *futex_hash_seq_start(struct seq_file *m, loff_t *pos)
+{
+	if (*pos == 0)
+		seq_printf(m, "# buckets %u\n# bucket contended waiters\n",
+			   futex_hashmask + 1);
+	return *pos <= futex_hashmask ? &futex_queues[*pos] : NULL;
+}
+
+static void *futex_hash_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return *pos <= futex_hashmask ? &futex_queues[*pos] : NULL;
+}
+
+static void futex_hash_seq_stop(struct seq_file *m, void *v)
+{
+}
+
+static int futex_hash_seq_show(struct seq_file *m, void *v)
+{
+	struct futex_hash_bucket *hb = v;
+	struct plist_node *node;
+	unsigned long contended = ACCESS_ONCE(hb->contended);
+	int waiters = 0;
+
+	if (!contended)
+		return 0;
+
+	spin_lock(&hb->lock);
+	plist_for_each(node, &hb->chain)
+		waiters++;
+	spin_unlock(&hb->lock);
+
+	seq_printf(m, "%8ld %12lu %8d\n",
+		   (long)(hb - futex_queues), contended, waiters);
+	return 0;
+}
+
+static const struct seq_operations futex_hash_seq_ops = {
+	.start	= futex_hash_seq_start,
+	.next	= futex_hash_seq_next,
+	.stop	= futex_hash_seq_stop,
+	.show	= futex_hash_seq_show,
+};
+
+static int futex_hash_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &futex_hash_seq_ops);
+}
+
+static const struct file_operations futex_hash_fops = {
+	.open		= futex_hash_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+static int __init futex_debugfs_init(void)
+{
+	debugfs_create_file("futex_hash", 0400, NULL, NULL, &futex_hash_fops);
+	return 0;
+}
+late_initcall(futex_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
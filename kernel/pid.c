@@ -97,8 +97,8 @@ int is_container_init(struct task_struct *tsk)
 EXPORT_SYMBOL(is_container_init);
 
 /*
- * Note: disable interrupts while the pidmap_lock is held as an
- * interrupt might come in and do read_lock(&tasklist_lock).
+ * Note: disable interrupts while the pidmap_lock or a pidhash lock is
+ * held as an interrupt might come in and do read_lock(&tasklist_lock).
  *
  * If we don't disable interrupts there is a nasty deadlock between
  * detach_pid()->free_pid() and another cpu that does
@@ -112,6 +112,42 @@ EXPORT_SYMBOL(is_container_init);
 
 static  __cacheline_aligned_in_smp DEFINE_SPINLOCK(pidmap_lock);
 
+/*
+ * The pid hash chains are changed under a lock per group of chains, so
+ * that forks and exits on different cpus do not all serialise on one
+ * lock.  Lookups walk the chains under RCU only.
+ */
+#define PIDHASH_LOCKS		(CONFIG_BASE_SMALL ? 1 : 64)
+
+static struct {
+	spinlock_t lock;
+} ____cacheline_aligned_in_smp pidhash_locks[PIDHASH_LOCKS];
+
+static inline spinlock_t *pidhash_lock(struct upid *upid)
+{
+	return &pidhash_locks[pid_hashfn(upid->nr, upid->ns) &
+			      (PIDHASH_LOCKS - 1)].lock;
+}
+
+/*
+ * Forks on different cpus all cmpxchg pid_ns->last_pid and then set
+ * bits in the same bitmap word.  In the initial namespace, each cpu
+ * instead claims the rest of the PID_CPU_RANGE aligned block of pids
+ * it was given, by moving last_pid to the end of the block, and hands
+ * those pids out itself.  The claim is dropped when the pid space wraps
+ * around meanwhile, so that pids are still reused in the usual order.
+ */
+#define PID_CPU_RANGE		BITS_PER_LONG
+
+struct pid_cpu_range {
+	int next;
+	int end;
+	int wraps;
+};
+
+static DEFINE_PER_CPU(struct pid_cpu_range, pid_cpu_range);
+static atomic_t pid_wraps = ATOMIC_INIT(0);
+
 static void free_pidmap(struct upid *upid)
 {
 	int nr = upid->nr;
@@ -165,8 +201,10 @@ static int alloc_pidmap(struct pid_namespace *pid_ns)
 	struct pidmap *map;
 
 	pid = last + 1;
-	if (pid >= pid_max)
+	if (pid >= pid_max) {
 		pid = RESERVED_PIDS;
+		atomic_inc(&pid_wraps);
+	}
 	offset = pid & BITS_PER_PAGE_MASK;
 	map = &pid_ns->pidmap[pid/BITS_PER_PAGE];
 	/*
@@ -209,6 +247,7 @@ static int alloc_pidmap(struct pid_namespace *pid_ns)
 		} else {
 			map = &pid_ns->pidmap[0];
 			offset = RESERVED_PIDS;
+			atomic_inc(&pid_wraps);
 			if (unlikely(last == offset))
 				break;
 		}
@@ -217,6 +256,48 @@ static int alloc_pidmap(struct pid_namespace *pid_ns)
 	return -1;
 }
 
+/* alloc_pidmap() for the initial namespace, see PID_CPU_RANGE */
+static int alloc_pidmap_cpu(struct pid_namespace *pid_ns)
+{
+	struct pid_cpu_range *range;
+	struct pidmap *map;
+	int pid, end, wraps;
+
+	range = &get_cpu_var(pid_cpu_range);
+	if (range->wraps != atomic_read(&pid_wraps))
+		range->next = range->end;
+	while (range->next < range->end) {
+		pid = range->next++;
+		if (unlikely(pid >= pid_max))
+			break;
+		/* the block's bitmap page exists: it held the claiming pid */
+		map = &pid_ns->pidmap[pid / BITS_PER_PAGE];
+		if (!test_and_set_bit(pid & BITS_PER_PAGE_MASK, map->page)) {
+			atomic_dec(&map->nr_free);
+			put_cpu_var(pid_cpu_range);
+			return pid;
+		}
+	}
+	range->next = range->end;
+	put_cpu_var(pid_cpu_range);
+
+	wraps = atomic_read(&pid_wraps);
+	pid = alloc_pidmap(pid_ns);
+	if (pid < 0)
+		return pid;
+
+	/* claim the rest of the block unless last_pid moved on already */
+	end = min(ALIGN(pid + 1, PID_CPU_RANGE), pid_max);
+	if (pid + 1 < end && cmpxchg(&pid_ns->last_pid, pid, end - 1) == pid) {
+		range = &get_cpu_var(pid_cpu_range);
+		range->next = pid + 1;
+		range->end = end;
+		range->wraps = wraps;
+		put_cpu_var(pid_cpu_range);
+	}
+	return pid;
+}
+
 int next_pidmap(struct pid_namespace *pid_ns, int last)
 {
 	int offset;
@@ -263,10 +344,13 @@ void free_pid(struct pid *pid)
 	int i;
 	unsigned long flags;
 
-	spin_lock_irqsave(&pidmap_lock, flags);
-	for (i = 0; i <= pid->level; i++)
+	for (i = 0; i <= pid->level; i++) {
+		spinlock_t *lock = pidhash_lock(pid->numbers + i);
+
+		spin_lock_irqsave(lock, flags);
 		hlist_del_rcu(&pid->numbers[i].pid_chain);
-	spin_unlock_irqrestore(&pidmap_lock, flags);
+		spin_unlock_irqrestore(lock, flags);
+	}
 
 	for (i = 0; i <= pid->level; i++)
 		free_pidmap(pid->numbers + i);
@@ -288,7 +372,10 @@ struct pid *alloc_pid(struct pid_namespace *ns)
 
 	tmp = ns;
 	for (i = ns->level; i >= 0; i--) {
-		nr = alloc_pidmap(tmp);
+		if (tmp == &init_pid_ns)
+			nr = alloc_pidmap_cpu(tmp);
+		else
+			nr = alloc_pidmap(tmp);
 		if (nr < 0)
 			goto out_free;
 
@@ -304,11 +391,14 @@ struct pid *alloc_pid(struct pid_namespace *ns)
 		INIT_HLIST_HEAD(&pid->tasks[type]);
 
 	upid = pid->numbers + ns->level;
-	spin_lock_irq(&pidmap_lock);
-	for ( ; upid >= pid->numbers; --upid)
+	for ( ; upid >= pid->numbers; --upid) {
+		spinlock_t *lock = pidhash_lock(upid);
+
+		spin_lock_irq(lock);
 		hlist_add_head_rcu(&upid->pid_chain,
 				&pid_hash[pid_hashfn(upid->nr, upid->ns)]);
-	spin_unlock_irq(&pidmap_lock);
+		spin_unlock_irq(lock);
+	}
 
 out:
 	return pid;
@@ -544,6 +634,8 @@ void __init pidhash_init(void)
 
 	for (i = 0; i < pidhash_size; i++)
 		INIT_HLIST_HEAD(&pid_hash[i]);
+	for (i = 0; i < PIDHASH_LOCKS; i++)
+		spin_lock_init(&pidhash_locks[i].lock);
 }
 
 void __init pidmap_init(void)
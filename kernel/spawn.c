@@ -0,0 +1,261 @@
+/*
+ * spawn(2): create a process running a new program, without copying
+ * the caller's address space first.
+ *
+ * fork() followed by exec() copies every vma and page table of the
+ * parent only for exec() to throw them away, which for a large parent
+ * costs far more than the exec itself.  vfork() avoids the copy, but
+ * then the child runs user code on the parent's memory.  spawn() does
+ * what posix_spawn() does with vfork(), except that the child never
+ * returns to user space before the exec: it is started in the kernel
+ * on the parent's mm, the way call_usermodehelper() starts its helpers,
+ * applies the file actions and execs.  The parent sleeps until the
+ * exec has given the child its own mm, and gets the exec error back if
+ * there was one.
+ *
+ * Until its exec succeeds the child has no exit signal, which also
+ * hides it from wait() without __WALL: if the exec fails, the parent
+ * reaps it without anybody else seeing a child or a SIGCHLD for a pid
+ * spawn() never returned.
+ */
+
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/syscalls.h>
+#include <linux/spawn.h>
+#include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/fcntl.h>
+#include <linux/err.h>
+#include <linux/compat.h>
+#include <linux/binfmts.h>
+#include <asm/uaccess.h>
+
+struct spawn_request {
+	const char __user *filename;
+	const char __user *const __user *argv;
+	const char __user *const __user *envp;
+	struct spawn_action *actions;
+	unsigned int nr_actions;
+	int error;
+};
+
+static int spawn_file_actions(struct spawn_request *req)
+{
+	unsigned int i;
+	long ret = 0;
+
+	for (i = 0; i < req->nr_actions; i++) {
+		struct spawn_action *a = req->actions + i;
+		long fd;
+
+		switch (a->type) {
+		case SPAWN_ACTION_CLOSE:
+			ret = sys_close(a->fd);
+			break;
+		case SPAWN_ACTION_DUP2:
+			ret = sys_dup2(a->srcfd, a->fd);
+			break;
+		case SPAWN_ACTION_OPEN:
+			fd = do_sys_open(AT_FDCWD, (const char __user *)
+					 (unsigned long)a->path,
+					 a->flags, a->mode);
+			ret = fd;
+			if (fd >= 0 && fd != a->fd) {
+				ret = sys_dup2(fd, a->fd);
+				sys_close(fd);
+			}
+			break;
+		}
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
+/* exit_signal is read under tasklist_lock by exit_notify() and wait() */
+static void spawn_set_exit_signal(int sig)
+{
+	write_lock_irq(&tasklist_lock);
+	current->exit_signal = sig;
+	write_unlock_irq(&tasklist_lock);
+}
+
+/*
+ * The new process.  It runs on the parent's mm, like a vfork child,
+ * with a copy of its descriptor table; the parent waits for it to exec
+ * or exit, so the request and the user arguments stay put meanwhile.
+ */
+static int spawn_child(void *data)
+{
+	struct spawn_request *req = data;
+	int retval;
+
+	retval = spawn_file_actions(req);
+	if (!retval) {
+		/* from here on, a successful exec makes us a normal child */
+		spawn_set_exit_signal(SIGCHLD);
+		retval = kernel_execve((const char __force *)req->filename,
+				       (const char *const __force *)req->argv,
+				       (const char *const __force *)req->envp);
+		spawn_set_exit_signal(0);
+	}
+
+	/* exec failed: the parent reaps us and returns the error */
+	req->error = retval;
+	return 127 << 8;
+}
+
+static long do_spawn(const char __user *filename,
+		     const char __user *const __user *argv,
+		     const char __user *const __user *envp,
+		     const struct spawn_action __user *actions,
+		     unsigned int nr_actions, unsigned int flags)
+{
+	struct spawn_request req;
+	unsigned int i;
+	long pid;
+
+	if (flags || nr_actions > SPAWN_ACTIONS_MAX)
+		return -EINVAL;
+
+	req.filename = filename;
+	req.argv = argv;
+	req.envp = envp;
+	req.nr_actions = nr_actions;
+	req.actions = NULL;
+	req.error = 0;
+
+	if (nr_actions) {
+		req.actions = memdup_user(actions,
+					  nr_actions * sizeof(*actions));
+		if (IS_ERR(req.actions))
+			return PTR_ERR(req.actions);
+	}
+	for (i = 0; i < nr_actions; i++) {
+		struct spawn_action *a = req.actions + i;
+
+		if (a->type < SPAWN_ACTION_CLOSE ||
+		    a->type > SPAWN_ACTION_OPEN || a->reserved) {
+			pid = -EINVAL;
+			goto out;
+		}
+	}
+
+	/*
+	 * CLONE_VFORK: sleep until the child has exec'ed or exited.  No
+	 * exit signal until spawn_child() sets one.
+	 */
+	pid = kernel_thread(spawn_child, &req, CLONE_VFORK);
+	if (pid > 0 && req.error) {
+		/*
+		 * Only a thread of ours waiting with __WALL can beat us to
+		 * reaping it, and then it is gone all the same.
+		 */
+		sys_wait4(pid, NULL, __WALL, NULL);
+		pid = req.error;
+	}
+out:
+	kfree(req.actions);
+	return pid;
+}
+
+/**
+ * sys_spawn - create a child process running a new program
+ * @filename:	the program, as for execve()
+ * @argv:	its arguments, as for execve()
+ * @envp:	its environment, as for execve()
+ * @actions:	file actions to apply in the child before the exec
+ * @nr_actions:	number of @actions, at most SPAWN_ACTIONS_MAX
+ * @flags:	must be zero
+ *
+ * Returns the pid of the child, which is a normal child of the caller
+ * and sends it SIGCHLD when it exits.  If a file action or the exec
+ * fails, the child is reaped and the error returned instead.  As with
+ * vfork(), other threads of the caller must not change the memory
+ * holding the arguments until the call returns.
+ */
+SYSCALL_DEFINE6(spawn, const char __user *, filename,
+		const char __user *const __user *, argv,
+		const char __user *const __user *, envp,
+		const struct spawn_action __user *, actions,
+		unsigned int, nr_actions, unsigned int, flags)
+{
+	return do_spawn(filename, argv, envp, actions, nr_actions, flags);
+}
+
+#ifdef CONFIG_COMPAT
+static long compat_spawn_count(compat_uptr_t __user *argv)
+{
+	compat_uptr_t p;
+	long i = 0;
+
+	if (!argv)
+		return 0;
+	for (;;) {
+		if (get_user(p, argv + i))
+			return -EFAULT;
+		if (!p)
+			return i;
+		if (++i >= MAX_ARG_STRINGS)
+			return -E2BIG;
+		if (fatal_signal_pending(current))
+			return -ERESTARTNOHAND;
+		cond_resched();
+	}
+}
+
+static int compat_spawn_copy(const char __user *__user *dst,
+			     compat_uptr_t __user *argv, long count)
+{
+	compat_uptr_t p;
+	long i;
+
+	for (i = 0; i < count; i++) {
+		if (get_user(p, argv + i) ||
+		    put_user(compat_ptr(p), dst + i))
+			return -EFAULT;
+	}
+	return put_user(NULL, dst + count);
+}
+
+/*
+ * spawn() for 32-bit callers: argv and envp are widened into native
+ * pointer arrays on the caller's stack, which the child sees as it
+ * shares the mm, and which nothing else touches while the caller
+ * sleeps in do_spawn().
+ */
+asmlinkage long compat_sys_spawn(const char __user *filename,
+				 compat_uptr_t __user *argv,
+				 compat_uptr_t __user *envp,
+				 const struct spawn_action __user *actions,
+				 unsigned int nr_actions, unsigned int flags)
+{
+	const char __user *__user *nargv, *__user *nenvp;
+	long argc, envc;
+	int error;
+
+	argc = compat_spawn_count(argv);
+	if (argc < 0)
+		return argc;
+	envc = compat_spawn_count(envp);
+	if (envc < 0)
+		return envc;
+
+	nargv = compat_alloc_user_space((argc + envc + 2) * sizeof(*nargv));
+	if (!nargv)
+		return -EFAULT;
+	nenvp = nargv + argc + 1;
+
+	error = compat_spawn_copy(nargv, argv, argc);
+	if (!error)
+		error = compat_spawn_copy(nenvp, envp, envc);
+	if (error)
+		return error;
+
+	return do_spawn(filename,
+			(const char __user *const __user *)(argv ? nargv : NULL),
+			(const char __user *const __user *)(envp ? nenvp : NULL),
+			actions, nr_actions, flags);
+}
+#endif
@@ -38,6 +38,7 @@
 #include <linux/writeback.h>
 #include <linux/ratelimit.h>
 #include <linux/compaction.h>
+#include <linux/prezero.h>
 #include <linux/hugetlb.h>
 #include <linux/initrd.h>
 #include <linux/key.h>
@@ -1163,6 +1164,22 @@ static struct ctl_table vm_table[] = {
 		.proc_handler	= min_free_kbytes_sysctl_handler,
 		.extra1		= &zero,
 	},
+	{
+		.procname	= "fault_around_bytes",
+		.data		= &sysctl_fault_around_bytes,
+		.maxlen		= sizeof(sysctl_fault_around_bytes),
+		.mode		= 0644,
+		.proc_handler	= proc_doulongvec_minmax,
+	},
+#ifdef CONFIG_PREZERO_PAGES
+	{
+		.procname	= "prezero_pages",
+		.data		= &sysctl_prezero_pages,
+		.maxlen		= sizeof(sysctl_prezero_pages),
+		.mode		= 0644,
+		.proc_handler	= prezero_sysctl_handler,
+	},
+#endif
 	{
 		.procname	= "percpu_pagelist_fraction",
 		.data		= &percpu_pagelist_fraction,
@@ -1386,6 +1403,27 @@ static struct ctl_table fs_table[] = {
 		.mode		= 0444,
 		.proc_handler	= proc_nr_dentry,
 	},
+	{
+		.procname	= "path-walk-state",
+		.data		= &path_walk_stat,
+		.maxlen		= 2*sizeof(unsigned long),
+		.mode		= 0444,
+		.proc_handler	= proc_path_walk_state,
+	},
+	{
+		.procname	= "fput-defer-max",
+		.data		= &sysctl_fput_defer_max,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+	},
+	{
+		.procname	= "fput-defer-state",
+		.maxlen		= sizeof(struct fput_defer_stat_t),
+		.mode		= 0444,
+		.proc_handler	= proc_fput_defer_state,
+	},
 	{
 		.procname	= "overflowuid",
 		.data		= &fs_overflowuid,
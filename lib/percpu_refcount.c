@@ -0,0 +1,40 @@
+/*
+ * Distributed per-cpu reference counts.
+ */
+
+#include <linux/percpu_refcount.h>
+#include <linux/errno.h>
+#include <linux/module.h>
+
+int percpu_refcount_init(struct percpu_refcount *ref, int count)
+{
+	ref->count = alloc_percpu(int);
+	if (!ref->count)
+		return -ENOMEM;
+	percpu_refcount_add(ref, count);
+	return 0;
+}
+EXPORT_SYMBOL(percpu_refcount_init);
+
+void percpu_refcount_destroy(struct percpu_refcount *ref)
+{
+	free_percpu(ref->count);
+	ref->count = NULL;
+}
+EXPORT_SYMBOL(percpu_refcount_destroy);
+
+/*
+ * Add up the slots of all CPUs.  Offline CPUs are included since they may
+ * still hold counts from before they went down.  The result is exact only
+ * if the caller prevents concurrent updates.
+ */
+int percpu_refcount_sum(struct percpu_refcount *ref)
+{
+	int sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *per_cpu_ptr(ref->count, cpu);
+	return sum;
+}
+EXPORT_SYMBOL(percpu_refcount_sum);
@@ -80,14 +80,14 @@
  *  ->i_mutex
  *    ->i_alloc_sem             (various)
  *
- *  ->inode_lock
- *    ->sb_lock			(fs/fs-writeback.c)
+ *  ->bdi->wb.list_lock
+ *    ->inode->i_lock		(fs/fs-writeback.c)
  *    ->mapping->tree_lock	(__sync_single_inode)
  *
  *  ->i_mmap_lock
- *    ->anon_vma.lock		(vma_adjust)
+ *    ->anon_vma.rwlock		(vma_adjust)
  *
- *  ->anon_vma.lock
+ *  ->anon_vma.rwlock
  *    ->page_table_lock or pte_lock	(anon_vma_prepare and various)
  *
  *  ->page_table_lock or pte_lock
@@ -98,8 +98,8 @@
  *    ->zone.lru_lock		(check_pte_range->isolate_lru_page)
  *    ->private_lock		(page_remove_rmap->set_page_dirty)
  *    ->tree_lock		(page_remove_rmap->set_page_dirty)
- *    ->inode_lock		(page_remove_rmap->set_page_dirty)
- *    ->inode_lock		(zap_pte_range->set_page_dirty)
+ *    ->inode->i_lock		(page_remove_rmap->set_page_dirty)
+ *    ->inode->i_lock		(zap_pte_range->set_page_dirty)
  *    ->private_lock		(zap_pte_range->__set_page_dirty_buffers)
  *
  *  ->task->proc_lock
@@ -464,6 +464,99 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+/**
+ * pagevec_add_to_page_cache_lru - add a batch of new pages to the pagecache
+ * @pvec:	the pages, with ->index set, in ascending index order
+ * @mapping:	the address_space to add them to
+ * @gfp_mask:	page allocation mode
+ *
+ * Does what add_to_page_cache_lru() does for each page of @pvec, but all
+ * the pages that fall in the same radix tree leaf are inserted under one
+ * radix_tree_preload() and one hold of the tree_lock.  Readahead inserts
+ * runs of consecutive indices, and taking the lock once per page is what
+ * readers streaming through one file end up contending on.
+ *
+ * The pages that were added, locked and with a pagecache reference, are
+ * moved to the front of @pvec in their original order, and their number
+ * is returned.  The others - already cached, or no memory - follow them
+ * unlocked.  The caller keeps its own reference to every page either way.
+ */
+unsigned pagevec_add_to_page_cache_lru(struct pagevec *pvec,
+		struct address_space *mapping, gfp_t gfp_mask)
+{
+	struct page *failed[PAGEVEC_SIZE];
+	bool charged[PAGEVEC_SIZE], added[PAGEVEC_SIZE];
+	unsigned nr = pagevec_count(pvec);
+	unsigned i, j, start, nr_added = 0, nr_failed = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = pvec->pages[i];
+
+		/* see add_to_page_cache_lru() */
+		if (mapping_cap_swap_backed(mapping))
+			SetPageSwapBacked(page);
+		__set_page_locked(page);
+		charged[i] = !mem_cgroup_cache_charge(page, current->mm,
+					gfp_mask & GFP_RECLAIM_MASK);
+		added[i] = false;
+	}
+
+	for (start = 0; start < nr; start = i) {
+		pgoff_t leaf = pvec->pages[start]->index >> RADIX_TREE_MAP_SHIFT;
+
+		for (i = start + 1; i < nr; i++) {
+			if (pvec->pages[i]->index >> RADIX_TREE_MAP_SHIFT != leaf)
+				break;
+		}
+
+		if (radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM))
+			continue;
+		spin_lock_irq(&mapping->tree_lock);
+		for (j = start; j < i; j++) {
+			struct page *page = pvec->pages[j];
+
+			if (!charged[j])
+				continue;
+			page_cache_get(page);
+			page->mapping = mapping;
+			if (radix_tree_insert(&mapping->page_tree,
+					      page->index, page)) {
+				page->mapping = NULL;
+				/* the caller's reference keeps the page */
+				page_cache_release(page);
+				continue;
+			}
+			mapping->nrpages++;
+			__inc_zone_page_state(page, NR_FILE_PAGES);
+			if (PageSwapBacked(page))
+				__inc_zone_page_state(page, NR_SHMEM);
+			added[j] = true;
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+		radix_tree_preload_end();
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = pvec->pages[i];
+
+		if (added[i]) {
+			if (page_is_file_cache(page))
+				lru_cache_add_file(page);
+			else
+				lru_cache_add_anon(page);
+			pvec->pages[nr_added++] = page;
+			continue;
+		}
+		if (charged[i])
+			mem_cgroup_uncharge_cache_page(page);
+		__clear_page_locked(page);
+		failed[nr_failed++] = page;
+	}
+	memcpy(pvec->pages + nr_added, failed, nr_failed * sizeof(failed[0]));
+	return nr_added;
+}
+EXPORT_SYMBOL_GPL(pagevec_add_to_page_cache_lru);
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
@@ -480,6 +573,31 @@ struct page *__page_cache_alloc(gfp_t gfp)
 	return alloc_pages(gfp, 0);
 }
 EXPORT_SYMBOL(__page_cache_alloc);
+
+/*
+ * The bulk allocator only knows the local node, so tasks whose page cache
+ * is spread over a cpuset or placed by a memory policy still get their
+ * pages one at a time.
+ */
+unsigned long __page_cache_alloc_bulk(gfp_t gfp, unsigned long nr_pages,
+				      struct list_head *list)
+{
+	unsigned long nr = 0;
+
+	if (!cpuset_do_page_mem_spread() && !current->mempolicy)
+		return alloc_pages_bulk_list(gfp, nr_pages, list);
+
+	while (nr < nr_pages) {
+		struct page *page = __page_cache_alloc(gfp);
+
+		if (!page)
+			break;
+		list_add_tail(&page->lru, list);
+		nr++;
+	}
+	return nr;
+}
+EXPORT_SYMBOL(__page_cache_alloc_bulk);
 #endif
 
 static int __sleep_on_page_lock(void *word)
@@ -1649,8 +1767,82 @@ page_not_uptodate:
 }
 EXPORT_SYMBOL(filemap_fault);
 
+/**
+ * filemap_map_pages - map page cache pages around a read fault
+ * @vma:	vma in which the fault was taken
+ * @vmf:	the window to map, see struct vm_fault
+ *
+ * Map the pages of the file from vmf->pgoff to vmf->max_pgoff that are
+ * already in the page cache and up to date into their ptes, starting at
+ * vmf->pte, if those are still empty.  This runs under the page table lock
+ * and so never sleeps: pages that are locked, not up to date or still
+ * flagged for readahead are left for ->fault() to deal with.
+ *
+ * Returns the number of ptes filled in.
+ */
+int filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	unsigned long address = (unsigned long)vmf->virtual_address;
+	pgoff_t index = vmf->pgoff;
+	struct pagevec pvec;
+	int mapped = 0;
+
+	pagevec_init(&pvec, 0);
+	while (index <= vmf->max_pgoff &&
+	       pagevec_lookup(&pvec, mapping, index,
+			min(vmf->max_pgoff - index, (pgoff_t)PAGEVEC_SIZE-1) + 1)) {
+		int i;
+
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+			pgoff_t size;
+			pte_t *pte;
+
+			index = page->index + 1;
+			if (page->index > vmf->max_pgoff)
+				goto skip;
+			if (!PageUptodate(page) || PageReadahead(page) ||
+			    PageHWPoison(page))
+				goto skip;
+			if (!trylock_page(page))
+				goto skip;
+			if (page->mapping != mapping || !PageUptodate(page))
+				goto unlock;
+
+			size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1)
+					>> PAGE_CACHE_SHIFT;
+			if (page->index >= size)
+				goto unlock;
+
+			pte = vmf->pte + page->index - vmf->pgoff;
+			if (!pte_none(*pte))
+				goto unlock;
+
+			if (file->f_ra.mmap_miss > 0)
+				file->f_ra.mmap_miss--;
+			/* the pte takes over our page reference */
+			do_set_pte(vma, address +
+				   ((page->index - vmf->pgoff) << PAGE_SHIFT),
+				   page, pte);
+			unlock_page(page);
+			mapped++;
+			continue;
+unlock:
+			unlock_page(page);
+skip:
+			page_cache_release(page);
+		}
+		pagevec_reinit(&pvec);
+	}
+	return mapped;
+}
+EXPORT_SYMBOL(filemap_map_pages);
+
 const struct vm_operations_struct generic_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
 };
 
 /* This is used for a general mmap of a disk file */
@@ -0,0 +1,1548 @@
+/*
+ * Transparent huge pages for anonymous memory.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ *
+ * A huge pmd maps HPAGE_PMD_NR small pages allocated as one naturally
+ * aligned block and then split_page()d: the pages are not compound, so
+ * everything that looks at a struct page - rmap, LRU, memcg, reclaim,
+ * migration - keeps working on small pages.  Only the page table walkers
+ * need to know about huge pmds, and any of them can fall back to small
+ * ptes with split_huge_pmd(), which uses the page table deposited for
+ * every huge pmd and so never allocates or fails.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/hugetlb.h>
+#include <linux/mmu_notifier.h>
+#include <linux/rmap.h>
+#include <linux/swap.h>
+#include <linux/mman.h>
+#include <linux/pagemap.h>
+#include <linux/memcontrol.h>
+#include <linux/kthread.h>
+#include <linux/khugepaged.h>
+#include <linux/freezer.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <asm/tlb.h>
+#include <asm/pgalloc.h>
+#include "internal.h"
+
+/*
+ * By default transparent hugepage support is enabled for all anonymous
+ * mappings or only for the madvise(MADV_HUGEPAGE) ones, depending on
+ * the Kconfig choice.  Only those that asked for it may stall in
+ * compaction at fault time; khugepaged always defragments, since
+ * nobody waits for it.
+ */
+unsigned long transparent_hugepage_flags __read_mostly =
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE_ALWAYS
+	(1<<TRANSPARENT_HUGEPAGE_FLAG)|
+#endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE_MADVISE
+	(1<<TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG)|
+#endif
+	(1<<TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG)|
+	(1<<TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG);
+
+#define khugepaged_enabled()					       \
+	(transparent_hugepage_flags &				       \
+	 ((1<<TRANSPARENT_HUGEPAGE_FLAG) |			       \
+	  (1<<TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG)))
+#define khugepaged_defrag()					       \
+	(transparent_hugepage_flags &				       \
+	 (1<<TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG))
+
+/* default scan 8*512 ptes (or vmas) every 10 seconds */
+static unsigned int khugepaged_pages_to_scan __read_mostly = HPAGE_PMD_NR*8;
+static unsigned int khugepaged_pages_collapsed;
+static unsigned int khugepaged_full_scans;
+static unsigned int khugepaged_scan_sleep_millisecs __read_mostly = 10000;
+/* during fragmentation poll the hugepage allocator once every minute */
+static unsigned int khugepaged_alloc_sleep_millisecs __read_mostly = 60000;
+static unsigned int khugepaged_max_ptes_none __read_mostly = HPAGE_PMD_NR-1;
+static struct task_struct *khugepaged_thread __read_mostly;
+static DEFINE_SPINLOCK(khugepaged_mm_lock);
+static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
+
+#define MM_SLOTS_HASH_SHIFT 10
+#define MM_SLOTS_HASH_HEADS (1 << MM_SLOTS_HASH_SHIFT)
+static struct hlist_head mm_slots_hash[MM_SLOTS_HASH_HEADS];
+static struct kmem_cache *mm_slot_cache __read_mostly;
+
+/**
+ * struct mm_slot - hash lookup from mm to mm_slot
+ * @hash: hash collision list
+ * @mm_node: khugepaged scan list headed in khugepaged_scan.mm_head
+ * @mm: the mm that this information is valid for
+ */
+struct mm_slot {
+	struct hlist_node hash;
+	struct list_head mm_node;
+	struct mm_struct *mm;
+};
+
+/**
+ * struct khugepaged_scan - cursor for scanning
+ * @mm_head: the head of the mm list to scan
+ * @mm_slot: the current mm_slot we are scanning
+ * @address: the next address inside that to be scanned
+ *
+ * There is only the one khugepaged_scan instance of this cursor structure.
+ */
+struct khugepaged_scan {
+	struct list_head mm_head;
+	struct mm_slot *mm_slot;
+	unsigned long address;
+};
+static struct khugepaged_scan khugepaged_scan = {
+	.mm_head = LIST_HEAD_INIT(khugepaged_scan.mm_head),
+};
+
+static int khugepaged_has_work(void)
+{
+	return !list_empty(&khugepaged_scan.mm_head) && khugepaged_enabled();
+}
+
+static int khugepaged_wait_event(void)
+{
+	return khugepaged_has_work() || kthread_should_stop();
+}
+
+#ifdef CONFIG_SYSFS
+/*
+ * This all compiles without CONFIG_SYSFS, but is a waste of space.
+ */
+
+#define THP_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+#define THP_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+static ssize_t double_flag_show(char *buf,
+				enum transparent_hugepage_flag enabled,
+				enum transparent_hugepage_flag req_madv)
+{
+	if (test_bit(enabled, &transparent_hugepage_flags)) {
+		VM_BUG_ON(test_bit(req_madv, &transparent_hugepage_flags));
+		return sprintf(buf, "[always] madvise never\n");
+	} else if (test_bit(req_madv, &transparent_hugepage_flags))
+		return sprintf(buf, "always [madvise] never\n");
+	else
+		return sprintf(buf, "always madvise [never]\n");
+}
+
+static ssize_t double_flag_store(const char *buf, size_t count,
+				 enum transparent_hugepage_flag enabled,
+				 enum transparent_hugepage_flag req_madv)
+{
+	if (!memcmp("always", buf, min(sizeof("always")-1, count))) {
+		set_bit(enabled, &transparent_hugepage_flags);
+		clear_bit(req_madv, &transparent_hugepage_flags);
+	} else if (!memcmp("madvise", buf, min(sizeof("madvise")-1, count))) {
+		clear_bit(enabled, &transparent_hugepage_flags);
+		set_bit(req_madv, &transparent_hugepage_flags);
+	} else if (!memcmp("never", buf, min(sizeof("never")-1, count))) {
+		clear_bit(enabled, &transparent_hugepage_flags);
+		clear_bit(req_madv, &transparent_hugepage_flags);
+	} else
+		return -EINVAL;
+
+	return count;
+}
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return double_flag_show(buf, TRANSPARENT_HUGEPAGE_FLAG,
+				TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG);
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	ssize_t ret;
+
+	ret = double_flag_store(buf, count, TRANSPARENT_HUGEPAGE_FLAG,
+				TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG);
+	if (ret > 0 && khugepaged_has_work())
+		wake_up_interruptible(&khugepaged_wait);
+
+	return ret;
+}
+THP_ATTR(enabled);
+
+static ssize_t defrag_show(struct kobject *kobj,
+			   struct kobj_attribute *attr, char *buf)
+{
+	return double_flag_show(buf, TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+				TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG);
+}
+
+static ssize_t defrag_store(struct kobject *kobj,
+			    struct kobj_attribute *attr,
+			    const char *buf, size_t count)
+{
+	return double_flag_store(buf, count, TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+				 TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG);
+}
+THP_ATTR(defrag);
+
+static struct attribute *hugepage_attrs[] = {
+	&enabled_attr.attr,
+	&defrag_attr.attr,
+	NULL,
+};
+
+static struct attribute_group hugepage_attr_group = {
+	.attrs = hugepage_attrs,
+};
+
+static ssize_t scan_sleep_millisecs_show(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_scan_sleep_millisecs);
+}
+
+static ssize_t scan_sleep_millisecs_store(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	khugepaged_scan_sleep_millisecs = msecs;
+	wake_up_interruptible(&khugepaged_wait);
+
+	return count;
+}
+THP_ATTR(scan_sleep_millisecs);
+
+static ssize_t alloc_sleep_millisecs_show(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_alloc_sleep_millisecs);
+}
+
+static ssize_t alloc_sleep_millisecs_store(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	khugepaged_alloc_sleep_millisecs = msecs;
+	wake_up_interruptible(&khugepaged_wait);
+
+	return count;
+}
+THP_ATTR(alloc_sleep_millisecs);
+
+static ssize_t pages_to_scan_show(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_pages_to_scan);
+}
+
+static ssize_t pages_to_scan_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned long pages;
+	int err;
+
+	err = strict_strtoul(buf, 10, &pages);
+	if (err || !pages || pages > UINT_MAX)
+		return -EINVAL;
+
+	khugepaged_pages_to_scan = pages;
+
+	return count;
+}
+THP_ATTR(pages_to_scan);
+
+static ssize_t pages_collapsed_show(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_pages_collapsed);
+}
+THP_ATTR_RO(pages_collapsed);
+
+static ssize_t full_scans_show(struct kobject *kobj,
+			       struct kobj_attribute *attr,
+			       char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_full_scans);
+}
+THP_ATTR_RO(full_scans);
+
+static ssize_t max_ptes_none_show(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_max_ptes_none);
+}
+
+static ssize_t max_ptes_none_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned long max_ptes_none;
+	int err;
+
+	err = strict_strtoul(buf, 10, &max_ptes_none);
+	if (err || max_ptes_none > HPAGE_PMD_NR-1)
+		return -EINVAL;
+
+	khugepaged_max_ptes_none = max_ptes_none;
+
+	return count;
+}
+THP_ATTR(max_ptes_none);
+
+static ssize_t khugepaged_defrag_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", !!test_bit(
+		TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG,
+		&transparent_hugepage_flags));
+}
+
+static ssize_t khugepaged_defrag_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	unsigned long value;
+	int err;
+
+	err = strict_strtoul(buf, 10, &value);
+	if (err || value > 1)
+		return -EINVAL;
+
+	if (value)
+		set_bit(TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG,
+			&transparent_hugepage_flags);
+	else
+		clear_bit(TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG,
+			  &transparent_hugepage_flags);
+
+	return count;
+}
+static struct kobj_attribute khugepaged_defrag_attr =
+	__ATTR(defrag, 0644, khugepaged_defrag_show,
+	       khugepaged_defrag_store);
+
+static struct attribute *khugepaged_attrs[] = {
+	&khugepaged_defrag_attr.attr,
+	&max_ptes_none_attr.attr,
+	&pages_to_scan_attr.attr,
+	&pages_collapsed_attr.attr,
+	&full_scans_attr.attr,
+	&scan_sleep_millisecs_attr.attr,
+	&alloc_sleep_millisecs_attr.attr,
+	NULL,
+};
+
+static struct attribute_group khugepaged_attr_group = {
+	.attrs = khugepaged_attrs,
+	.name = "khugepaged",
+};
+#endif /* CONFIG_SYSFS */
+
+static int khugepaged(void *none);
+
+static int __init hugepage_init(void)
+{
+	int err;
+#ifdef CONFIG_SYSFS
+	struct kobject *hugepage_kobj;
+#endif
+
+	mm_slot_cache = KMEM_CACHE(mm_slot, 0);
+	if (!mm_slot_cache)
+		return -ENOMEM;
+
+	khugepaged_thread = kthread_run(khugepaged, NULL, "khugepaged");
+	if (IS_ERR(khugepaged_thread)) {
+		printk(KERN_ERR "hugepage: creating kthread failed\n");
+		err = PTR_ERR(khugepaged_thread);
+		khugepaged_thread = NULL;
+		goto out_free;
+	}
+
+#ifdef CONFIG_SYSFS
+	err = -ENOMEM;
+	hugepage_kobj = kobject_create_and_add("transparent_hugepage", mm_kobj);
+	if (!hugepage_kobj) {
+		printk(KERN_ERR "hugepage: failed kobject create\n");
+		goto out;
+	}
+
+	err = sysfs_create_group(hugepage_kobj, &hugepage_attr_group);
+	if (err) {
+		printk(KERN_ERR "hugepage: failed register hugepage group\n");
+		goto out;
+	}
+
+	err = sysfs_create_group(hugepage_kobj, &khugepaged_attr_group);
+	if (err)
+		printk(KERN_ERR "hugepage: failed register khugepaged group\n");
+out:
+#endif
+	/* the thread and the defaults work without the sysfs knobs */
+	return 0;
+
+out_free:
+	kmem_cache_destroy(mm_slot_cache);
+	return err;
+}
+module_init(hugepage_init)
+
+static int __init setup_transparent_hugepage(char *str)
+{
+	int ret = 0;
+
+	if (!str)
+		goto out;
+	if (!strcmp(str, "always")) {
+		set_bit(TRANSPARENT_HUGEPAGE_FLAG,
+			&transparent_hugepage_flags);
+		clear_bit(TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+			  &transparent_hugepage_flags);
+		ret = 1;
+	} else if (!strcmp(str, "madvise")) {
+		clear_bit(TRANSPARENT_HUGEPAGE_FLAG,
+			  &transparent_hugepage_flags);
+		set_bit(TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+			&transparent_hugepage_flags);
+		ret = 1;
+	} else if (!strcmp(str, "never")) {
+		clear_bit(TRANSPARENT_HUGEPAGE_FLAG,
+			  &transparent_hugepage_flags);
+		clear_bit(TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+			  &transparent_hugepage_flags);
+		ret = 1;
+	}
+out:
+	if (!ret)
+		printk(KERN_WARNING
+		       "transparent_hugepage= cannot parse, ignored\n");
+	return ret;
+}
+__setup("transparent_hugepage=", setup_transparent_hugepage);
+
+/*
+ * The page tables deposited for huge pmds, so that splitting one never
+ * has to allocate.  They are kept in a list per mm under
+ * page_table_lock: which page table goes with which pmd doesn't matter.
+ */
+static void pgtable_trans_huge_deposit(struct mm_struct *mm, pgtable_t pgtable)
+{
+	assert_spin_locked(&mm->page_table_lock);
+
+	if (!mm->pmd_huge_pte)
+		INIT_LIST_HEAD(&pgtable->lru);
+	else
+		list_add(&pgtable->lru, &mm->pmd_huge_pte->lru);
+	mm->pmd_huge_pte = pgtable;
+}
+
+static pgtable_t pgtable_trans_huge_withdraw(struct mm_struct *mm)
+{
+	pgtable_t pgtable;
+
+	assert_spin_locked(&mm->page_table_lock);
+
+	pgtable = mm->pmd_huge_pte;
+	VM_BUG_ON(!pgtable);
+	if (list_empty(&pgtable->lru))
+		mm->pmd_huge_pte = NULL;
+	else {
+		mm->pmd_huge_pte = list_entry(pgtable->lru.next,
+					      struct page, lru);
+		list_del(&pgtable->lru);
+	}
+	return pgtable;
+}
+
+static pmd_t *mm_find_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+	return pmd_offset(pud, address);
+}
+
+static inline gfp_t alloc_hugepage_gfpmask(int defrag)
+{
+	return (GFP_HIGHUSER_MOVABLE & ~(defrag ? 0 : __GFP_WAIT)) |
+		__GFP_NOWARN | __GFP_NORETRY;
+}
+
+static struct page *alloc_hugepage_vma(int defrag, struct vm_area_struct *vma,
+				       unsigned long haddr)
+{
+	struct page *page;
+
+	page = alloc_pages_vma(alloc_hugepage_gfpmask(defrag),
+			       HPAGE_PMD_ORDER, vma, haddr);
+	if (page)
+		split_page(page, HPAGE_PMD_ORDER);
+	return page;
+}
+
+static int charge_hugepage(struct page *page, struct mm_struct *mm)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (mem_cgroup_newpage_charge(page + i, mm, GFP_KERNEL)) {
+			while (--i >= 0)
+				mem_cgroup_uncharge_page(page + i);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static void release_hugepage(struct page *page, int charged)
+{
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (charged)
+			mem_cgroup_uncharge_page(page + i);
+		put_page(page + i);
+	}
+}
+
+static inline pmd_t maybe_pmd_mkwrite(pmd_t pmd, struct vm_area_struct *vma)
+{
+	if (likely(vma->vm_flags & VM_WRITE))
+		pmd = pmd_mkwrite(pmd);
+	return pmd;
+}
+
+/*
+ * Map the new pages at haddr, called with page_table_lock held and
+ * the page contents visible.
+ */
+static void map_hugepage(struct mm_struct *mm, struct vm_area_struct *vma,
+			 unsigned long haddr, pmd_t *pmd, struct page *page)
+{
+	pmd_t entry;
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_new_anon_rmap(page + i, vma, haddr + i * PAGE_SIZE);
+	entry = mk_pmd(page, vma->vm_page_prot);
+	entry = maybe_pmd_mkwrite(pmd_mkdirty(entry), vma);
+	entry = pmd_mkhuge(entry);
+	set_pmd_at(mm, haddr, pmd, entry);
+	__inc_zone_page_state(page, NR_ANON_TRANSPARENT_HUGEPAGES);
+}
+
+int do_huge_pmd_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			       unsigned long address, pmd_t *pmd,
+			       unsigned int flags)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgtable_t pgtable;
+	struct page *page;
+	int i;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+	if (unlikely(anon_vma_prepare(vma)))
+		return VM_FAULT_OOM;
+	if (unlikely(khugepaged_enter(vma)))
+		return VM_FAULT_OOM;
+
+	page = alloc_hugepage_vma(transparent_hugepage_defrag(vma), vma, haddr);
+	if (unlikely(!page)) {
+		count_vm_event(THP_FAULT_FALLBACK);
+		return VM_FAULT_FALLBACK;
+	}
+	if (unlikely(charge_hugepage(page, mm))) {
+		release_hugepage(page, 0);
+		count_vm_event(THP_FAULT_FALLBACK);
+		return VM_FAULT_FALLBACK;
+	}
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable)) {
+		release_hugepage(page, 1);
+		return VM_FAULT_OOM;
+	}
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		clear_user_highpage(page + i, haddr + i * PAGE_SIZE);
+		__SetPageUptodate(page + i);
+		cond_resched();
+	}
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		/* another thread got here first: let the access retry */
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pgtable);
+		release_hugepage(page, 1);
+		return 0;
+	}
+	map_hugepage(mm, vma, haddr, pmd, page);
+	pgtable_trans_huge_deposit(mm, pgtable);
+	mm->nr_ptes++;
+	add_mm_counter(mm, MM_ANONPAGES, HPAGE_PMD_NR);
+	spin_unlock(&mm->page_table_lock);
+
+	count_vm_event(THP_FAULT_ALLOC);
+	return 0;
+}
+
+/*
+ * Returns 0 if the huge pmd was copied, 1 if it was split meanwhile and
+ * the caller must copy the ptes, or -ENOMEM.
+ */
+int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
+		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
+		  struct vm_area_struct *vma)
+{
+	pgtable_t pgtable;
+	struct page *page;
+	pmd_t pmd;
+	int i, ret;
+
+	pgtable = pte_alloc_one(dst_mm, addr);
+	if (unlikely(!pgtable))
+		return -ENOMEM;
+
+	spin_lock(&dst_mm->page_table_lock);
+	spin_lock_nested(&src_mm->page_table_lock, SINGLE_DEPTH_NESTING);
+
+	ret = 1;
+	pmd = *src_pmd;
+	if (unlikely(!pmd_trans_huge(pmd))) {
+		pte_free(dst_mm, pgtable);
+		goto out_unlock;
+	}
+
+	page = pmd_page(pmd);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		get_page(page + i);
+		page_dup_rmap(page + i);
+	}
+	pmdp_set_wrprotect(src_mm, addr, src_pmd);
+	pmd = pmd_mkold(pmd_wrprotect(pmd));
+	set_pmd_at(dst_mm, addr, dst_pmd, pmd);
+	pgtable_trans_huge_deposit(dst_mm, pgtable);
+	dst_mm->nr_ptes++;
+	add_mm_counter(dst_mm, MM_ANONPAGES, HPAGE_PMD_NR);
+	__inc_zone_page_state(page, NR_ANON_TRANSPARENT_HUGEPAGES);
+	ret = 0;
+
+out_unlock:
+	spin_unlock(&src_mm->page_table_lock);
+	spin_unlock(&dst_mm->page_table_lock);
+	return ret;
+}
+
+/*
+ * Replace the huge pmd by the deposited page table mapping the same
+ * pages with the same protection.  The pmd is made non-present before
+ * the ptes are filled in, so the accessed and dirty bits copied to them
+ * are final and lockless walkers (gup_fast, faults) back off and retry
+ * until the page table is in place.
+ */
+static void __split_huge_pmd_locked(struct mm_struct *mm, pmd_t *pmd,
+				    unsigned long haddr)
+{
+	pgtable_t pgtable;
+	unsigned long pfn;
+	pgprot_t prot;
+	pmd_t old, _pmd;
+	pte_t *pte;
+	int i;
+
+	pgtable = pgtable_trans_huge_withdraw(mm);
+	old = pmdp_invalidate(mm, haddr, pmd);
+	flush_tlb_mm(mm);
+
+	pfn = pmd_pfn(old);
+	prot = pmd_pgprot(old);
+	pmd_populate(mm, &_pmd, pgtable);
+	for (i = 0; i < HPAGE_PMD_NR; i++, haddr += PAGE_SIZE) {
+		pte = pte_offset_map(&_pmd, haddr);
+		BUG_ON(!pte_none(*pte));
+		set_pte_at(mm, haddr, pte, pfn_pte(pfn + i, prot));
+		pte_unmap(pte);
+	}
+
+	smp_wmb(); /* make the ptes visible before the pmd */
+	pmd_populate(mm, pmd, pgtable);
+
+	__dec_zone_page_state(pfn_to_page(pfn), NR_ANON_TRANSPARENT_HUGEPAGES);
+	count_vm_event(THP_SPLIT);
+}
+
+void __split_huge_pmd(struct mm_struct *mm, pmd_t *pmd, unsigned long address)
+{
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd)))
+		__split_huge_pmd_locked(mm, pmd, address & HPAGE_PMD_MASK);
+	spin_unlock(&mm->page_table_lock);
+}
+
+/*
+ * For rmap walkers: split the huge pmd at @address if it maps @page.
+ * Returns 0, leaving the pmd alone, if it maps other pages - those of a
+ * child that broke COW on the range before it was collapsed, say.
+ */
+int split_huge_pmd_page(struct mm_struct *mm, pmd_t *pmd,
+			unsigned long address, struct page *page)
+{
+	int ret = 1;
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd))) {
+		if (page_to_pfn(page) - pmd_pfn(*pmd) < HPAGE_PMD_NR)
+			__split_huge_pmd_locked(mm, pmd,
+						address & HPAGE_PMD_MASK);
+		else
+			ret = 0;
+	}
+	spin_unlock(&mm->page_table_lock);
+	return ret;
+}
+
+/*
+ * Write fault on a write protected huge pmd: keep it huge if this mm is
+ * the only one mapping its pages, which is the case after the other
+ * side of a fork exited or exec'ed.  Otherwise split it and let the pte
+ * path copy just the page that is written to.
+ */
+int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			unsigned long address, pmd_t *pmd, pmd_t orig_pmd)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *page;
+	int i, ret = 0;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_same(*pmd, orig_pmd)))
+		goto out_unlock;
+
+	page = pmd_page(orig_pmd);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (page_mapcount(page + i) != 1)
+			break;
+	if (i == HPAGE_PMD_NR) {
+		pmd_t entry;
+
+		entry = pmd_mkyoung(pmd_mkdirty(orig_pmd));
+		entry = maybe_pmd_mkwrite(entry, vma);
+		pmdp_set_access_flags(vma, haddr, pmd, entry, 1);
+		ret |= VM_FAULT_WRITE;
+		goto out_unlock;
+	}
+
+	__split_huge_pmd_locked(mm, pmd, haddr);
+	ret = VM_FAULT_FALLBACK;
+
+out_unlock:
+	spin_unlock(&mm->page_table_lock);
+	return ret;
+}
+
+/* Called with page_table_lock held on a huge pmd */
+struct page *follow_trans_huge_pmd(struct vm_area_struct *vma,
+				   unsigned long addr, pmd_t *pmd,
+				   unsigned int flags)
+{
+	struct page *page;
+
+	assert_spin_locked(&vma->vm_mm->page_table_lock);
+
+	if ((flags & FOLL_WRITE) && !pmd_write(*pmd))
+		return NULL;
+
+	page = pmd_page(*pmd) + ((addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT);
+	if (flags & FOLL_GET)
+		get_page(page);
+	if (flags & FOLL_TOUCH) {
+		if ((flags & FOLL_WRITE) && !pmd_dirty(*pmd) &&
+		    !PageDirty(page))
+			set_page_dirty(page);
+		mark_page_accessed(page);
+	}
+	return page;
+}
+
+/*
+ * Unmap a huge pmd covering the whole range being zapped.  Returns 0
+ * if it was split meanwhile and the caller must zap the ptes.
+ */
+int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
+		 pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = tlb->mm;
+	pgtable_t pgtable;
+	struct page *page;
+	pmd_t orig_pmd;
+	int i;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		return 0;
+	}
+	orig_pmd = pmdp_get_and_clear(mm, addr, pmd);
+	tlb_remove_pmd_tlb_entry(tlb, pmd, addr);
+	pgtable = pgtable_trans_huge_withdraw(mm);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+
+	page = pmd_page(orig_pmd);
+	dec_zone_page_state(page, NR_ANON_TRANSPARENT_HUGEPAGES);
+	add_mm_counter(mm, MM_ANONPAGES, -HPAGE_PMD_NR);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page_remove_rmap(page + i);
+		tlb_remove_page(tlb, page + i);
+	}
+	pte_free(mm, pgtable);
+	return 1;
+}
+
+/*
+ * mprotect of a range covering the whole huge pmd.  Returns 0 if it was
+ * split meanwhile and the caller must change the ptes.
+ */
+int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+		    unsigned long addr, pgprot_t newprot)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	int ret = 0;
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd))) {
+		pmd_t entry;
+
+		entry = pmdp_get_and_clear(mm, addr, pmd);
+		entry = pmd_modify(entry, newprot);
+		set_pmd_at(mm, addr, pmd, entry);
+		ret = 1;
+	}
+	spin_unlock(&mm->page_table_lock);
+	return ret;
+}
+
+/*
+ * page_referenced_one() for a page mapped by a huge pmd, which would
+ * otherwise be split by page_check_address().  Returns -1 if @page is
+ * not mapped by a huge pmd at @address.
+ *
+ * All the pages of the pmd share its accessed bit.  Only aging the
+ * first of them clears it, so each of the others is found referenced
+ * if the range was touched since the first one last went round the LRU.
+ */
+int huge_pmd_referenced(struct page *page, struct vm_area_struct *vma,
+			unsigned long address, unsigned int *mapcount,
+			unsigned long *vm_flags)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	int referenced = 0, young = 0;
+	pmd_t *pmd;
+
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || !pmd_trans_huge(*pmd))
+		return -1;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_trans_huge(*pmd) ||
+		     page_to_pfn(page) - pmd_pfn(*pmd) >= HPAGE_PMD_NR)) {
+		spin_unlock(&mm->page_table_lock);
+		return -1;
+	}
+
+	if (vma->vm_flags & VM_LOCKED) {
+		*mapcount = 1;	/* break early from loop */
+		*vm_flags |= VM_LOCKED;
+		goto out_unlock;
+	}
+
+	if (page == pmd_page(*pmd)) {
+		if (pmdp_test_and_clear_young(vma, haddr, pmd)) {
+			flush_tlb_range(vma, haddr, haddr + HPAGE_PMD_SIZE);
+			young = 1;
+		}
+	} else
+		young = pmd_young(*pmd);
+	if (mmu_notifier_clear_flush_young(mm, address))
+		young = 1;
+	if (young && likely(!VM_SequentialReadHint(vma)))
+		referenced++;
+
+	/* Pretend the page is referenced if the task has the
+	   swap token and is in the middle of a page fault. */
+	if (mm != current->mm && has_swap_token(mm) &&
+			rwsem_is_locked(&mm->mmap_sem))
+		referenced++;
+
+out_unlock:
+	(*mapcount)--;
+	spin_unlock(&mm->page_table_lock);
+
+	if (referenced)
+		*vm_flags |= vma->vm_flags;
+	return referenced;
+}
+
+static void split_huge_pmd_address(struct vm_area_struct *vma,
+				   unsigned long address)
+{
+	pmd_t *pmd;
+
+	pmd = mm_find_pmd(vma->vm_mm, address);
+	if (pmd)
+		split_huge_pmd(vma->vm_mm, pmd, address);
+}
+
+/* Is there a huge pmd in @vma that straddles @address? */
+static inline int huge_pmd_straddles(struct vm_area_struct *vma,
+				     unsigned long address)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+
+	return (address & ~HPAGE_PMD_MASK) && haddr >= vma->vm_start &&
+		haddr + HPAGE_PMD_SIZE <= vma->vm_end;
+}
+
+/*
+ * vma_adjust() is about to move the boundaries of @vma (and of the next
+ * vma, by @adjust_next pages): split any huge pmd that would end up
+ * across one of them.
+ */
+void __vma_adjust_trans_huge(struct vm_area_struct *vma, unsigned long start,
+			     unsigned long end, long adjust_next)
+{
+	if (huge_pmd_straddles(vma, start))
+		split_huge_pmd_address(vma, start);
+	if (huge_pmd_straddles(vma, end))
+		split_huge_pmd_address(vma, end);
+	if (adjust_next > 0) {
+		struct vm_area_struct *next = vma->vm_next;
+		unsigned long nstart = next->vm_start;
+
+		nstart += adjust_next << PAGE_SHIFT;
+		if (huge_pmd_straddles(next, nstart))
+			split_huge_pmd_address(next, nstart);
+	}
+}
+
+int hugepage_madvise(struct vm_area_struct *vma,
+		     unsigned long *vm_flags, int advice)
+{
+	switch (advice) {
+	case MADV_HUGEPAGE:
+		if (*vm_flags & VM_NO_THP)
+			return -EINVAL;
+		*vm_flags &= ~VM_NOHUGEPAGE;
+		*vm_flags |= VM_HUGEPAGE;
+		/*
+		 * The vma only gets the flag after we return, so
+		 * khugepaged_enter() cannot see it yet: register the mm
+		 * for khugepaged here.
+		 */
+		if (!test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags) &&
+		    __khugepaged_enter(vma->vm_mm))
+			return -ENOMEM;
+		break;
+	case MADV_NOHUGEPAGE:
+		if (*vm_flags & VM_NO_THP)
+			return -EINVAL;
+		*vm_flags &= ~VM_HUGEPAGE;
+		*vm_flags |= VM_NOHUGEPAGE;
+		break;
+	}
+
+	return 0;
+}
+
+static inline struct mm_slot *alloc_mm_slot(void)
+{
+	return kmem_cache_zalloc(mm_slot_cache, GFP_KERNEL);
+}
+
+static inline void free_mm_slot(struct mm_slot *mm_slot)
+{
+	kmem_cache_free(mm_slot_cache, mm_slot);
+}
+
+static struct mm_slot *get_mm_slot(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	struct hlist_head *bucket;
+	struct hlist_node *node;
+
+	bucket = &mm_slots_hash[hash_ptr(mm, MM_SLOTS_HASH_SHIFT)];
+	hlist_for_each_entry(mm_slot, node, bucket, hash) {
+		if (mm == mm_slot->mm)
+			return mm_slot;
+	}
+	return NULL;
+}
+
+static void insert_to_mm_slots_hash(struct mm_struct *mm,
+				    struct mm_slot *mm_slot)
+{
+	struct hlist_head *bucket;
+
+	bucket = &mm_slots_hash[hash_ptr(mm, MM_SLOTS_HASH_SHIFT)];
+	mm_slot->mm = mm;
+	hlist_add_head(&mm_slot->hash, bucket);
+}
+
+static inline int khugepaged_test_exit(struct mm_struct *mm)
+{
+	return atomic_read(&mm->mm_users) == 0;
+}
+
+int __khugepaged_enter(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int wakeup;
+
+	mm_slot = alloc_mm_slot();
+	if (!mm_slot)
+		return -ENOMEM;
+
+	/* __khugepaged_exit() must not run until __khugepaged_enter returns */
+	VM_BUG_ON(khugepaged_test_exit(mm));
+	if (unlikely(test_and_set_bit(MMF_VM_HUGEPAGE, &mm->flags))) {
+		free_mm_slot(mm_slot);
+		return 0;
+	}
+
+	spin_lock(&khugepaged_mm_lock);
+	insert_to_mm_slots_hash(mm, mm_slot);
+	/*
+	 * Insert just behind the scanning cursor, to let the area settle
+	 * down a little.
+	 */
+	wakeup = list_empty(&khugepaged_scan.mm_head);
+	list_add_tail(&mm_slot->mm_node, &khugepaged_scan.mm_head);
+	spin_unlock(&khugepaged_mm_lock);
+
+	atomic_inc(&mm->mm_count);
+	if (wakeup)
+		wake_up_interruptible(&khugepaged_wait);
+
+	return 0;
+}
+
+void __khugepaged_exit(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int free = 0;
+
+	spin_lock(&khugepaged_mm_lock);
+	mm_slot = get_mm_slot(mm);
+	if (mm_slot && khugepaged_scan.mm_slot != mm_slot) {
+		hlist_del(&mm_slot->hash);
+		list_del(&mm_slot->mm_node);
+		free = 1;
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	if (free) {
+		clear_bit(MMF_VM_HUGEPAGE, &mm->flags);
+		free_mm_slot(mm_slot);
+		mmdrop(mm);
+	} else if (mm_slot) {
+		/*
+		 * khugepaged is scanning this mm: wait for it to drop
+		 * mmap_sem, after which it sees mm_users == 0, before
+		 * exit_mmap() tears down the page tables.  The mm_slot
+		 * is freed by khugepaged.
+		 */
+		down_write(&mm->mmap_sem);
+		up_write(&mm->mmap_sem);
+	}
+}
+
+static void release_pte_page(struct page *page)
+{
+	/* 0 stands for page_is_file_cache(page) == false */
+	dec_zone_page_state(page, NR_ISOLATED_ANON + 0);
+	unlock_page(page);
+	putback_lru_page(page);
+}
+
+static void release_pte_pages(pte_t *pte, pte_t *_pte)
+{
+	while (--_pte >= pte) {
+		pte_t pteval = *_pte;
+		if (!pte_none(pteval))
+			release_pte_page(pte_page(pteval));
+	}
+}
+
+/*
+ * Lock and isolate every page mapped by the ptes, which must all be
+ * private, writable, anonymous and referenced by nothing but the pte.
+ * Called under the pte lock with the pmd already cleared.
+ */
+static int __collapse_huge_page_isolate(struct vm_area_struct *vma,
+					unsigned long address, pte_t *pte)
+{
+	struct page *page;
+	pte_t *_pte;
+	int none = 0;
+
+	for (_pte = pte; _pte < pte+HPAGE_PMD_NR;
+	     _pte++, address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+
+		if (pte_none(pteval)) {
+			if (++none <= khugepaged_max_ptes_none)
+				continue;
+			goto out;
+		}
+		if (!pte_present(pteval) || !pte_write(pteval))
+			goto out;
+		page = vm_normal_page(vma, address, pteval);
+		if (unlikely(!page))
+			goto out;
+		VM_BUG_ON(PageCompound(page));
+		if (!PageAnon(page))
+			goto out;
+		/* a gup pin or a pagevec may still look at the page */
+		if (page_count(page) != 1)
+			goto out;
+		if (!trylock_page(page))
+			goto out;
+		if (isolate_lru_page(page)) {
+			unlock_page(page);
+			goto out;
+		}
+		/* 0 stands for page_is_file_cache(page) == false */
+		inc_zone_page_state(page, NR_ISOLATED_ANON + 0);
+	}
+	return 1;
+
+out:
+	release_pte_pages(pte, _pte);
+	return 0;
+}
+
+static void __collapse_huge_page_copy(pte_t *pte, struct page *page,
+				      struct vm_area_struct *vma,
+				      unsigned long address,
+				      spinlock_t *ptl)
+{
+	pte_t *_pte;
+
+	for (_pte = pte; _pte < pte+HPAGE_PMD_NR;
+	     _pte++, page++, address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+		struct page *src_page;
+
+		if (pte_none(pteval)) {
+			clear_user_highpage(page, address);
+			add_mm_counter(vma->vm_mm, MM_ANONPAGES, 1);
+		} else {
+			src_page = pte_page(pteval);
+			copy_user_highpage(page, src_page, address, vma);
+			VM_BUG_ON(page_mapcount(src_page) != 1);
+			VM_BUG_ON(page_count(src_page) != 2);
+			/*
+			 * The pmd is gone, so nobody else can reach the
+			 * pte: the lock only keeps the debug checks happy.
+			 */
+			spin_lock(ptl);
+			pte_clear(vma->vm_mm, address, _pte);
+			page_remove_rmap(src_page);
+			spin_unlock(ptl);
+			/* 0 stands for page_is_file_cache(page) == false */
+			dec_zone_page_state(src_page, NR_ISOLATED_ANON + 0);
+			unlock_page(src_page);
+			/* drop the isolation reference, then the pte's */
+			put_page(src_page);
+			put_page(src_page);
+		}
+		__SetPageUptodate(page);
+		cond_resched();
+	}
+}
+
+/*
+ * Replace the page table at @address by a huge pmd mapping a copy of
+ * its pages.  Called with mmap_sem held for reading, which is dropped:
+ * the huge page is allocated first, then mmap_sem is taken for writing
+ * to keep page faults and other walkers out while the ptes are copied.
+ */
+static void collapse_huge_page(struct mm_struct *mm, unsigned long address,
+			       struct vm_area_struct *vma, int *alloc_failed)
+{
+	pgtable_t pgtable;
+	struct page *new_page;
+	pmd_t *pmd, _pmd;
+	pte_t *pte;
+	spinlock_t *ptl;
+	int isolated;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	new_page = alloc_hugepage_vma(khugepaged_defrag(), vma, address);
+	up_read(&mm->mmap_sem);
+	if (unlikely(!new_page)) {
+		count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+		*alloc_failed = 1;
+		return;
+	}
+	count_vm_event(THP_COLLAPSE_ALLOC);
+	if (unlikely(charge_hugepage(new_page, mm))) {
+		release_hugepage(new_page, 0);
+		return;
+	}
+
+	down_write(&mm->mmap_sem);
+	if (unlikely(khugepaged_test_exit(mm)))
+		goto out;
+
+	vma = find_vma(mm, address);
+	if (!vma || address < vma->vm_start ||
+	    address + HPAGE_PMD_SIZE > vma->vm_end)
+		goto out;
+	if (!vma->anon_vma || !transparent_hugepage_enabled(vma) ||
+	    (vma->vm_flags & VM_LOCKED))
+		goto out;
+
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd || !pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		goto out;
+
+	mmu_notifier_invalidate_range_start(mm, address,
+					    address + HPAGE_PMD_SIZE);
+	anon_vma_lock(vma->anon_vma);
+
+	pte = pte_offset_map(pmd, address);
+	ptl = pte_lockptr(mm, pmd);
+
+	/*
+	 * Clear the pmd and flush the TLB: after the flush IPI no
+	 * gup_fast or speculative fault can still be walking the old
+	 * page table.  It is a full flush because the page table is
+	 * deposited and eventually freed, so lazy tlb cpus must drop
+	 * it too.
+	 */
+	spin_lock(&mm->page_table_lock);
+	_pmd = pmdp_get_and_clear(mm, address, pmd);
+	flush_tlb_mm(mm);
+	spin_unlock(&mm->page_table_lock);
+
+	spin_lock(ptl);
+	isolated = __collapse_huge_page_isolate(vma, address, pte);
+	spin_unlock(ptl);
+
+	if (unlikely(!isolated)) {
+		pte_unmap(pte);
+		spin_lock(&mm->page_table_lock);
+		BUG_ON(!pmd_none(*pmd));
+		set_pmd_at(mm, address, pmd, _pmd);
+		spin_unlock(&mm->page_table_lock);
+		anon_vma_unlock(vma->anon_vma);
+		mmu_notifier_invalidate_range_end(mm, address,
+						  address + HPAGE_PMD_SIZE);
+		goto out;
+	}
+
+	/*
+	 * All the pages are isolated and locked and no pmd points to
+	 * them any more: rmap walkers will not find them.
+	 */
+	anon_vma_unlock(vma->anon_vma);
+
+	__collapse_huge_page_copy(pte, new_page, vma, address, ptl);
+	pte_unmap(pte);
+	mmu_notifier_invalidate_range_end(mm, address,
+					  address + HPAGE_PMD_SIZE);
+
+	pgtable = pmd_pgtable(_pmd);
+
+	smp_wmb(); /* make the copies visible before the pmd */
+
+	spin_lock(&mm->page_table_lock);
+	BUG_ON(!pmd_none(*pmd));
+	map_hugepage(mm, vma, address, pmd, new_page);
+	/* the old page table is empty now: deposit it, nr_ptes is unchanged */
+	pgtable_trans_huge_deposit(mm, pgtable);
+	spin_unlock(&mm->page_table_lock);
+
+	khugepaged_pages_collapsed++;
+	up_write(&mm->mmap_sem);
+	return;
+
+out:
+	up_write(&mm->mmap_sem);
+	release_hugepage(new_page, 1);
+}
+
+/*
+ * Look at the ptes mapping the huge page sized range at @address and
+ * collapse them if they are worth it.  Returns 1 if mmap_sem was
+ * released.
+ */
+static int khugepaged_scan_pmd(struct mm_struct *mm,
+			       struct vm_area_struct *vma,
+			       unsigned long address, int *alloc_failed)
+{
+	pmd_t *pmd, pmdval;
+	pte_t *pte, *_pte;
+	int ret = 0, referenced = 0, none = 0;
+	struct page *page;
+	unsigned long _address;
+	spinlock_t *ptl;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	pmd = mm_find_pmd(mm, address);
+	if (!pmd)
+		return 0;
+	pmdval = *pmd;
+	barrier();
+	if (!pmd_present(pmdval) || pmd_trans_huge(pmdval))
+		return 0;
+
+	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
+	for (_address = address, _pte = pte; _pte < pte+HPAGE_PMD_NR;
+	     _pte++, _address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+
+		if (pte_none(pteval)) {
+			if (++none <= khugepaged_max_ptes_none)
+				continue;
+			goto out_unmap;
+		}
+		if (!pte_present(pteval) || !pte_write(pteval))
+			goto out_unmap;
+		page = vm_normal_page(vma, _address, pteval);
+		if (unlikely(!page))
+			goto out_unmap;
+		VM_BUG_ON(PageCompound(page));
+		if (!PageLRU(page) || PageLocked(page) || !PageAnon(page))
+			goto out_unmap;
+		/* mapcount is not enough: a gup pin forbids collapsing */
+		if (page_count(page) != 1)
+			goto out_unmap;
+		if (pte_young(pteval) || PageReferenced(page))
+			referenced = 1;
+	}
+	/* leave ranges nobody touched lately alone */
+	if (referenced)
+		ret = 1;
+out_unmap:
+	pte_unmap_unlock(pte, ptl);
+	if (ret)
+		collapse_huge_page(mm, address, vma, alloc_failed);
+	return ret;
+}
+
+static void collect_mm_slot(struct mm_slot *mm_slot)
+{
+	struct mm_struct *mm = mm_slot->mm;
+
+	VM_BUG_ON(!spin_is_locked(&khugepaged_mm_lock));
+
+	if (khugepaged_test_exit(mm)) {
+		hlist_del(&mm_slot->hash);
+		list_del(&mm_slot->mm_node);
+		free_mm_slot(mm_slot);
+		mmdrop(mm);
+	}
+}
+
+static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
+					    int *alloc_failed)
+	__releases(&khugepaged_mm_lock)
+	__acquires(&khugepaged_mm_lock)
+{
+	struct mm_slot *mm_slot;
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	unsigned int progress = 0;
+
+	VM_BUG_ON(!pages);
+	VM_BUG_ON(!spin_is_locked(&khugepaged_mm_lock));
+
+	if (khugepaged_scan.mm_slot)
+		mm_slot = khugepaged_scan.mm_slot;
+	else {
+		mm_slot = list_entry(khugepaged_scan.mm_head.next,
+				     struct mm_slot, mm_node);
+		khugepaged_scan.address = 0;
+		khugepaged_scan.mm_slot = mm_slot;
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	mm = mm_slot->mm;
+	down_read(&mm->mmap_sem);
+	if (unlikely(khugepaged_test_exit(mm)))
+		vma = NULL;
+	else
+		vma = find_vma(mm, khugepaged_scan.address);
+
+	progress++;
+	for (; vma; vma = vma->vm_next) {
+		unsigned long hstart, hend;
+
+		cond_resched();
+		if (unlikely(khugepaged_test_exit(mm))) {
+			progress++;
+			break;
+		}
+
+		if (!vma->anon_vma || !transparent_hugepage_enabled(vma) ||
+		    (vma->vm_flags & VM_LOCKED)) {
+			progress++;
+			continue;
+		}
+		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+		hend = vma->vm_end & HPAGE_PMD_MASK;
+		if (hstart >= hend || khugepaged_scan.address >= hend) {
+			progress++;
+			continue;
+		}
+		if (khugepaged_scan.address < hstart)
+			khugepaged_scan.address = hstart;
+
+		while (khugepaged_scan.address < hend) {
+			int ret;
+
+			cond_resched();
+			if (unlikely(khugepaged_test_exit(mm)))
+				goto breakouterloop;
+
+			ret = khugepaged_scan_pmd(mm, vma,
+						  khugepaged_scan.address,
+						  alloc_failed);
+			khugepaged_scan.address += HPAGE_PMD_SIZE;
+			progress += HPAGE_PMD_NR;
+			if (ret)
+				/* we released mmap_sem so break loop */
+				goto breakouterloop_mmap_sem;
+			if (progress >= pages)
+				goto breakouterloop;
+		}
+	}
+breakouterloop:
+	up_read(&mm->mmap_sem); /* exit_mmap will destroy ptes after this */
+breakouterloop_mmap_sem:
+
+	spin_lock(&khugepaged_mm_lock);
+	VM_BUG_ON(khugepaged_scan.mm_slot != mm_slot);
+	/*
+	 * Release the current mm_slot if this mm is about to die, or
+	 * if we scanned all vmas of this mm.
+	 */
+	if (khugepaged_test_exit(mm) || !vma) {
+		/*
+		 * Make sure that if mm_users is reaching zero while
+		 * khugepaged runs here, khugepaged_exit will find
+		 * mm_slot not pointing to the exiting mm.
+		 */
+		if (mm_slot->mm_node.next != &khugepaged_scan.mm_head) {
+			khugepaged_scan.mm_slot = list_entry(
+				mm_slot->mm_node.next,
+				struct mm_slot, mm_node);
+			khugepaged_scan.address = 0;
+		} else {
+			khugepaged_scan.mm_slot = NULL;
+			khugepaged_full_scans++;
+		}
+
+		collect_mm_slot(mm_slot);
+	}
+
+	return progress;
+}
+
+/* Returns 1 if a huge page could not be allocated */
+static int khugepaged_do_scan(void)
+{
+	unsigned int progress = 0, pass_through_head = 0;
+	unsigned int pages = khugepaged_pages_to_scan;
+	int alloc_failed = 0;
+
+	barrier(); /* write khugepaged_pages_to_scan to local stack */
+
+	while (progress < pages && !alloc_failed) {
+		cond_resched();
+
+		if (unlikely(kthread_should_stop() || freezing(current)))
+			break;
+
+		spin_lock(&khugepaged_mm_lock);
+		if (!khugepaged_scan.mm_slot)
+			pass_through_head++;
+		if (khugepaged_has_work() && pass_through_head < 2)
+			progress += khugepaged_scan_mm_slot(pages - progress,
+							    &alloc_failed);
+		else
+			progress = pages;
+		spin_unlock(&khugepaged_mm_lock);
+	}
+
+	return alloc_failed;
+}
+
+static int khugepaged(void *none)
+{
+	set_freezable();
+	set_user_nice(current, 19);
+
+	while (!kthread_should_stop()) {
+		unsigned int msecs;
+
+		if (khugepaged_do_scan())
+			msecs = khugepaged_alloc_sleep_millisecs;
+		else
+			msecs = khugepaged_scan_sleep_millisecs;
+
+		if (khugepaged_has_work()) {
+			if (msecs)
+				wait_event_freezable_timeout(khugepaged_wait,
+						kthread_should_stop(),
+						msecs_to_jiffies(msecs));
+		} else
+			wait_event_freezable(khugepaged_wait,
+					     khugepaged_wait_event());
+	}
+
+	spin_lock(&khugepaged_mm_lock);
+	khugepaged_scan.mm_slot = NULL;
+	spin_unlock(&khugepaged_mm_lock);
+	return 0;
+}
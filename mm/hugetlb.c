@@ -2245,6 +2245,7 @@ void __unmap_hugepage_range(struct vm_area_struct *vma, unsigned long start,
 	struct page *tmp;
 	struct hstate *h = hstate_vma(vma);
 	unsigned long sz = huge_page_size(h);
+	int unshared = 0;
 
 	/*
 	 * A page gathering list, protected by per file i_mmap_lock. The
@@ -2264,8 +2265,10 @@ void __unmap_hugepage_range(struct vm_area_struct *vma, unsigned long start,
 		if (!ptep)
 			continue;
 
-		if (huge_pmd_unshare(mm, &address, ptep))
+		if (huge_pmd_unshare(mm, &address, ptep)) {
+			unshared = 1;
 			continue;
+		}
 
 		/*
 		 * If a reference page is supplied, it is because a specific
@@ -2304,7 +2307,11 @@ void __unmap_hugepage_range(struct vm_area_struct *vma, unsigned long start,
 		list_add(&page->lru, &page_list);
 	}
 	spin_unlock(&mm->page_table_lock);
-	flush_tlb_range(vma, start, end);
+	/* an unshared pmd page is a page table going away: flush it all */
+	if (unshared)
+		flush_tlb_mm(mm);
+	else
+		flush_tlb_range(vma, start, end);
 	mmu_notifier_invalidate_range_end(mm, start, end);
 	list_for_each_entry_safe(page, tmp, &page_list, lru) {
 		page_remove_rmap(page);
@@ -2847,6 +2854,7 @@ void hugetlb_change_protection(struct vm_area_struct *vma,
 	pte_t *ptep;
 	pte_t pte;
 	struct hstate *h = hstate_vma(vma);
+	int unshared = 0;
 
 	BUG_ON(address >= end);
 	flush_cache_range(vma, address, end);
@@ -2857,8 +2865,10 @@ void hugetlb_change_protection(struct vm_area_struct *vma,
 		ptep = huge_pte_offset(mm, address);
 		if (!ptep)
 			continue;
-		if (huge_pmd_unshare(mm, &address, ptep))
+		if (huge_pmd_unshare(mm, &address, ptep)) {
+			unshared = 1;
 			continue;
+		}
 		if (!huge_pte_none(huge_ptep_get(ptep))) {
 			pte = huge_ptep_get_and_clear(mm, address, ptep);
 			pte = pte_mkhuge(pte_modify(pte, newprot));
@@ -2868,7 +2878,10 @@ void hugetlb_change_protection(struct vm_area_struct *vma,
 	spin_unlock(&mm->page_table_lock);
 	spin_unlock(&vma->vm_file->f_mapping->i_mmap_lock);
 
-	flush_tlb_range(vma, start, end);
+	if (unshared)
+		flush_tlb_mm(mm);
+	else
+		flush_tlb_range(vma, start, end);
 }
 
 int hugetlb_reserve_pages(struct inode *inode,
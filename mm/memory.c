@@ -40,6 +40,7 @@
 
 #include <linux/kernel_stat.h>
 #include <linux/mm.h>
+#include <linux/vmacache.h>
 #include <linux/hugetlb.h>
 #include <linux/mman.h>
 #include <linux/swap.h>
@@ -57,6 +58,7 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/prezero.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -416,7 +418,7 @@ int __pte_alloc(struct mm_struct *mm, pmd_t *pmd, unsigned long address)
 	smp_wmb(); /* Could be smp_wmb__xxx(before|after)_spin_lock */
 
 	spin_lock(&mm->page_table_lock);
-	if (!pmd_present(*pmd)) {	/* Has another populated it ? */
+	if (likely(pmd_none(*pmd))) {	/* Has another populated it ? */
 		mm->nr_ptes++;
 		pmd_populate(mm, pmd, new);
 		new = NULL;
@@ -795,6 +797,18 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 	src_pmd = pmd_offset(src_pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
+		if (pmd_trans_huge(*src_pmd)) {
+			int err;
+
+			VM_BUG_ON(next-addr != HPAGE_PMD_SIZE);
+			err = copy_huge_pmd(dst_mm, src_mm,
+					    dst_pmd, src_pmd, addr, vma);
+			if (err == -ENOMEM)
+				return -ENOMEM;
+			if (!err)
+				continue;
+			/* fall through */
+		}
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
@@ -997,7 +1011,20 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		if (pmd_none_or_clear_bad(pmd)) {
+		if (pmd_trans_huge(*pmd)) {
+			if (next-addr != HPAGE_PMD_SIZE)
+				split_huge_pmd(vma->vm_mm, pmd, addr);
+			else if (zap_huge_pmd(tlb, vma, pmd, addr)) {
+				(*zap_work) -= PAGE_SIZE;
+				continue;
+			}
+			/* fall through */
+		}
+		/*
+		 * mmap_sem may be held only for reading (MADV_DONTNEED), so
+		 * a huge pmd can show up here from under us: skip it.
+		 */
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd)) {
 			(*zap_work)--;
 			continue;
 		}
@@ -1273,11 +1300,21 @@ struct page *follow_page(struct vm_area_struct *vma, unsigned long address,
 	pmd = pmd_offset(pud, address);
 	if (pmd_none(*pmd))
 		goto no_page_table;
-	if (pmd_huge(*pmd)) {
+	if (pmd_huge(*pmd) && vma->vm_flags & VM_HUGETLB) {
 		BUG_ON(flags & FOLL_GET);
 		page = follow_huge_pmd(mm, address, pmd, flags & FOLL_WRITE);
 		goto out;
 	}
+	if (pmd_trans_huge(*pmd)) {
+		spin_lock(&mm->page_table_lock);
+		if (likely(pmd_trans_huge(*pmd))) {
+			page = follow_trans_huge_pmd(vma, address, pmd, flags);
+			spin_unlock(&mm->page_table_lock);
+			goto out;
+		}
+		spin_unlock(&mm->page_table_lock);
+		/* split meanwhile: look at the ptes */
+	}
 	if (unlikely(pmd_bad(*pmd)))
 		goto no_page_table;
 
@@ -2087,6 +2124,21 @@ static inline void cow_user_page(struct page *dst, struct page *src, unsigned lo
 		copy_user_highpage(dst, src, va, vma);
 }
 
+/*
+ * Allocate a zeroed page for a private anonymous mapping, from the local
+ * node's pre-zeroed pool when there is one.  @vma may be NULL if it has no
+ * memory policy of its own.
+ */
+static inline struct page *alloc_zeroed_anon_page(struct vm_area_struct *vma,
+						  unsigned long address)
+{
+	struct page *page = prezero_alloc_page(vma);
+
+	if (page)
+		return page;
+	return alloc_zeroed_user_highpage_movable(vma, address);
+}
+
 /*
  * This routine handles present pages, when users try to write
  * to a shared page. It is done by copying the page to a new address
@@ -2245,7 +2297,7 @@ gotten:
 		goto oom;
 
 	if (is_zero_pfn(pte_pfn(orig_pte))) {
-		new_page = alloc_zeroed_user_highpage_movable(vma, address);
+		new_page = alloc_zeroed_anon_page(vma, address);
 		if (!new_page)
 			goto oom;
 	} else {
@@ -2863,7 +2915,7 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	/* Allocate our own private page. */
 	if (unlikely(anon_vma_prepare(vma)))
 		goto oom;
-	page = alloc_zeroed_user_highpage_movable(vma, address);
+	page = alloc_zeroed_anon_page(vma, address);
 	if (!page)
 		goto oom;
 	__SetPageUptodate(page);
@@ -3091,14 +3143,101 @@ unwritable_page:
 	return ret;
 }
 
+/*
+ * Size of the window that a read fault on a file mapping maps in one go,
+ * see do_fault_around().  Rounded down to a power of two pages, and to at
+ * most one page table.
+ */
+unsigned long sysctl_fault_around_bytes __read_mostly = 65536;
+
+static inline unsigned long fault_around_pages(void)
+{
+	unsigned long nr = ACCESS_ONCE(sysctl_fault_around_bytes) >> PAGE_SHIFT;
+
+	if (nr <= 1)
+		return 0;
+	return min_t(unsigned long, rounddown_pow_of_two(nr), PTRS_PER_PTE);
+}
+
+/**
+ * do_set_pte - map a page cache page for fault-around
+ * @vma:	vma the page is mapped into
+ * @address:	user virtual address of the page
+ * @page:	locked page cache page
+ * @pte:	empty pte for @address, with the page table lock held
+ *
+ * Maps @page as a read fault would; the caller's reference on the page
+ * becomes the pte's.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte)
+{
+	struct mm_struct *mm = vma->vm_mm;
+
+	flush_icache_page(vma, page);
+	inc_mm_counter_fast(mm, MM_FILEPAGES);
+	page_add_file_rmap(page);
+	set_pte_at(mm, address, pte, mk_pte(page, vma->vm_page_prot));
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, pte);
+}
+
+/*
+ * On a read fault in a file mapping, first map whatever the page cache
+ * already holds around @address: the fault_around_pages() aligned window
+ * containing it, clipped to the vma.  The window never crosses a page
+ * table, so one pte lock covers it.
+ *
+ * Returns true if the pte at @address is no longer the one we faulted on,
+ * either because ->map_pages() filled it or because somebody else did;
+ * there is then nothing left for ->fault() to do.
+ */
+static bool do_fault_around(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pmd_t *pmd, pgoff_t pgoff,
+		unsigned int flags, pte_t orig_pte, unsigned long nr_pages)
+{
+	unsigned long window = address & ~(nr_pages * PAGE_SIZE - 1);
+	unsigned long start = max(window, vma->vm_start);
+	unsigned long end = min(window + nr_pages * PAGE_SIZE, vma->vm_end);
+	unsigned long off = (address - start) >> PAGE_SHIFT;
+	struct vm_fault vmf;
+	spinlock_t *ptl;
+	pte_t *pte;
+	bool done;
+	int nr;
+
+	pte = pte_offset_map_lock(mm, pmd, start, &ptl);
+
+	vmf.virtual_address = (void __user *)start;
+	vmf.pgoff = pgoff - off;
+	vmf.max_pgoff = vmf.pgoff + ((end - start) >> PAGE_SHIFT) - 1;
+	vmf.pte = pte;
+	vmf.flags = flags;
+	vmf.page = NULL;
+
+	nr = vma->vm_ops->map_pages(vma, &vmf);
+	count_vm_event(FAULT_AROUND);
+	count_vm_events(FAULT_AROUND_PTES, nr);
+
+	done = !pte_same(pte[off], orig_pte);
+	pte_unmap_unlock(pte, ptl);
+	return done;
+}
+
 static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
 		unsigned int flags, pte_t orig_pte)
 {
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	unsigned long nr_pages = fault_around_pages();
 
 	pte_unmap(page_table);
+	if (!(flags & FAULT_FLAG_WRITE) && vma->vm_ops->map_pages &&
+	    nr_pages && do_fault_around(mm, vma, address & PAGE_MASK, pmd,
+					pgoff, flags, orig_pte, nr_pages))
+		return 0;
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
@@ -3228,13 +3367,283 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	pte = pte_alloc_map(mm, pmd, address);
-	if (!pte)
+	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
+		int ret = do_huge_pmd_anonymous_page(mm, vma, address,
+						     pmd, flags);
+		if (!(ret & VM_FAULT_FALLBACK))
+			return ret;
+	} else {
+		pmd_t orig_pmd = *pmd;
+
+		barrier();
+		if (pmd_trans_huge(orig_pmd)) {
+			int ret;
+
+			/*
+			 * Nothing to do on a read fault, or on a pmd being
+			 * split: it was spurious, or the access retries.
+			 */
+			if (!(flags & FAULT_FLAG_WRITE) ||
+			    pmd_write(orig_pmd))
+				return 0;
+			ret = do_huge_pmd_wp_page(mm, vma, address,
+						  pmd, orig_pmd);
+			if (!(ret & VM_FAULT_FALLBACK))
+				return ret;
+		}
+	}
+
+	/*
+	 * Not pte_alloc_map(): a huge pmd may be installed by another
+	 * thread from under us, and pte_offset_map() must not be run on it.
+	 */
+	if (unlikely(pmd_none(*pmd)) && __pte_alloc(mm, pmd, address))
 		return VM_FAULT_OOM;
+	/* if a huge pmd materialized from under us, just retry later */
+	if (unlikely(pmd_trans_huge(*pmd)))
+		return 0;
+	pte = pte_offset_map(pmd, address);
 
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults.
+ *
+ * Most faults in a multi-threaded process are the first touch of an
+ * anonymous page.  Taking mmap_sem for them makes every such fault wait
+ * for any mmap, munmap or mprotect in the process, however far away,
+ * and bounces the rwsem between all the faulting cpus.
+ * handle_speculative_fault() resolves that fault without mmap_sem:
+ *
+ * - The vma is looked up in the thread's vmacache or in mm_rb under RCU,
+ *   and the lookup is checked against mm->vmacache_seqnum or
+ *   mm->mm_rb_seq.  vmas are freed after a grace period, so one found
+ *   this way can still be read while it is being unmapped.
+ * - The vma's fields are only trusted while its vm_sequence, which
+ *   every writer of those fields bumps, is unchanged.  The last check
+ *   is made under the pte lock: a writer that changes the vma and then
+ *   fixes up its ptes (munmap, mprotect) takes the same lock, so either
+ *   it comes after us and sees our pte, or we see its sequence change
+ *   and back out.  mm->mm_seq does the same for mremap, which moves
+ *   ptes away from a vma that stays in the tree.
+ * - The page tables are walked with interrupts disabled.  They are only
+ *   freed after a TLB flush IPI to every cpu running the mm, this one
+ *   included.  The pte lock is only tried: its holder may be waiting
+ *   for our IPI.
+ *
+ * Everything else - file, shared, stack, mlocked and NUMA policy vmas,
+ * a missing page table, a populated pte, or a racing writer - returns
+ * VM_FAULT_RETRY, and the caller takes the ordinary path with mmap_sem.
+ */
+
+/* Far deeper than an rbtree of sysctl_max_map_count vmas can get */
+#define SPF_MAX_RB_DEPTH	64
+
+/*
+ * Like read_seqcount_begin(), but fails instead of spinning: a writer
+ * preempted by this task would never finish while we spin with
+ * interrupts disabled.
+ */
+static inline int spf_seq_begin(seqcount_t *s, unsigned int *seq)
+{
+	*seq = ACCESS_ONCE(s->sequence);
+	smp_rmb();
+	return !(*seq & 1);
+}
+
+/*
+ * Find the vma for @addr and sample its vm_sequence into *@seq.  The
+ * sample is taken while the lookup is still known to be valid, so the
+ * vma was in the tree when it was taken: removing a vma bumps both
+ * vmacache_seqnum and mm_rb_seq before its vm_sequence settles again.
+ *
+ * vmacache_seqnum is bumped inside the mm_rb_seq write section, after
+ * the vma left the tree.  A walk that starts after vmacache_find() saw
+ * the new seqnum therefore either sees the write section still open or
+ * a tree without the vma, and never caches a removed vma under the
+ * current seqnum.
+ */
+static struct vm_area_struct *find_vma_speculative(struct mm_struct *mm,
+					unsigned long addr, unsigned int *seq)
+{
+	struct vm_area_struct *vma;
+	struct rb_node *node;
+	unsigned int rb_seq;
+	int depth = 0;
+
+	vma = vmacache_find(mm, addr);
+	if (vma) {
+		if (!spf_seq_begin(&vma->vm_sequence, seq))
+			return NULL;
+		if (ACCESS_ONCE(mm->vmacache_seqnum) != current->vmacache_seqnum)
+			return NULL;
+		return vma;
+	}
+
+	/* order the seqnum read in vmacache_find() before the walk */
+	smp_rmb();
+	if (!spf_seq_begin(&mm->mm_rb_seq, &rb_seq))
+		return NULL;
+
+	node = ACCESS_ONCE(mm->mm_rb.rb_node);
+	while (node) {
+		struct vm_area_struct *tmp;
+
+		/* a concurrent rotation may send us round in circles */
+		if (++depth > SPF_MAX_RB_DEPTH)
+			return NULL;
+		tmp = rb_entry(node, struct vm_area_struct, vm_rb);
+		if (tmp->vm_end > addr) {
+			vma = tmp;
+			if (tmp->vm_start <= addr)
+				break;
+			node = ACCESS_ONCE(node->rb_left);
+		} else
+			node = ACCESS_ONCE(node->rb_right);
+	}
+
+	if (!vma || !spf_seq_begin(&vma->vm_sequence, seq))
+		return NULL;
+	if (read_seqcount_retry(&mm->mm_rb_seq, rb_seq))
+		return NULL;
+	vmacache_update(addr, vma);
+	return vma;
+}
+
+static int spf_vma_ok(struct vm_area_struct *vma, unsigned long address,
+		      unsigned int flags)
+{
+	unsigned long vm_flags = vma->vm_flags;
+
+	if (address < vma->vm_start || address >= vma->vm_end)
+		return 0;
+	if (vma->vm_ops || vma->vm_file || !vma->anon_vma || vma_policy(vma))
+		return 0;
+	if (vm_flags & (VM_GROWSDOWN | VM_GROWSUP | VM_LOCKED |
+			VM_IO | VM_PFNMAP | VM_MIXEDMAP))
+		return 0;
+	if (flags & FAULT_FLAG_WRITE)
+		return vm_flags & VM_WRITE;
+	return vm_flags & (VM_READ | VM_WRITE | VM_EXEC);
+}
+
+/*
+ * Called without mmap_sem.  Returns 0 if the fault was handled, or
+ * VM_FAULT_RETRY if the caller must handle it with handle_mm_fault().
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma;
+	struct page *page = NULL;
+	unsigned int seq, mm_seq;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, pmdval;
+	pte_t *pte, entry;
+	spinlock_t *ptl;
+	int ok;
+
+	/*
+	 * A write fault needs a page, and allocating it may sleep.  See
+	 * whether this is a fault we can handle at all, allocate, then
+	 * look the vma up again from scratch.
+	 */
+	if (flags & FAULT_FLAG_WRITE) {
+		rcu_read_lock();
+		vma = find_vma_speculative(mm, address, &seq);
+		ok = vma && spf_vma_ok(vma, address, flags);
+		rcu_read_unlock();
+		if (!ok)
+			return VM_FAULT_RETRY;
+
+		/* the vma has no policy of its own, so the task's applies */
+		page = alloc_zeroed_anon_page(NULL, address);
+		if (!page)
+			return VM_FAULT_RETRY;
+		__SetPageUptodate(page);
+		if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+			page_cache_release(page);
+			return VM_FAULT_RETRY;
+		}
+	}
+
+	rcu_read_lock();
+	local_irq_disable();
+	if (!spf_seq_begin(&mm->mm_seq, &mm_seq))
+		goto abort;
+	vma = find_vma_speculative(mm, address, &seq);
+	if (!vma)
+		goto abort;
+	if (!spf_vma_ok(vma, address, flags))
+		goto fallback;
+
+	if (page)
+		entry = pte_mkwrite(pte_mkdirty(mk_pte(page, vma->vm_page_prot)));
+	else
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+						vma->vm_page_prot));
+
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto fallback;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto fallback;
+	pmd = pmd_offset(pud, address);
+	pmdval = *pmd;
+	barrier();
+	if (pmd_none(pmdval) || unlikely(pmd_bad(pmdval)))
+		goto fallback;
+
+	pte = pte_offset_map(&pmdval, address);
+	ptl = pte_lockptr(mm, &pmdval);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(pte);
+		goto abort;
+	}
+	if (pmd_val(*pmd) != pmd_val(pmdval) || !pte_none(*pte) ||
+	    read_seqcount_retry(&vma->vm_sequence, seq) ||
+	    read_seqcount_retry(&mm->mm_seq, mm_seq)) {
+		pte_unmap_unlock(pte, ptl);
+		goto abort;
+	}
+	/*
+	 * Whoever unmaps the vma or frees this page table from here on
+	 * has to take the pte lock first.
+	 */
+	local_irq_enable();
+
+	if (page) {
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	}
+	set_pte_at(mm, address, pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, pte);
+	pte_unmap_unlock(pte, ptl);
+	rcu_read_unlock();
+
+	count_vm_event(PGFAULT);
+	count_vm_event(SPF_FAULT);
+	return 0;
+
+abort:
+	count_vm_event(SPF_ABORT);
+fallback:
+	local_irq_enable();
+	rcu_read_unlock();
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
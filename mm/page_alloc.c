@@ -1075,6 +1075,49 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 }
 #endif
 
+#ifdef CONFIG_SMP
+/*
+ * Resize a cpu's pcp list to fit the way it has been used since the last
+ * call.  A cpu that both refilled the list from the buddy allocator and
+ * spilled it back more than once is cycling more pages than the list
+ * holds, so high and batch are doubled, up to PCP_AUTOTUNE_SHIFT_MAX
+ * times their boot values.  Otherwise they are halved back towards the
+ * boot values and any excess pages are returned to the buddy lists.
+ *
+ * Called about once a second for each cpu from refresh_cpu_vm_stats().
+ * Lists whose high mark was set through percpu_pagelist_fraction are left
+ * alone.
+ */
+#define PCP_AUTOTUNE_SHIFT_MAX	2
+#define PCP_AUTOTUNE_EVENTS	2
+
+void pcp_autotune(struct zone *zone, struct per_cpu_pages *pcp)
+{
+	unsigned long flags;
+
+	if (!pcp->high_base)
+		return;
+
+	local_irq_save(flags);
+	if (pcp->refills >= PCP_AUTOTUNE_EVENTS &&
+	    pcp->drains >= PCP_AUTOTUNE_EVENTS) {
+		if (pcp->shift < PCP_AUTOTUNE_SHIFT_MAX)
+			pcp->shift++;
+	} else if (pcp->shift)
+		pcp->shift--;
+	pcp->refills = 0;
+	pcp->drains = 0;
+
+	pcp->high = pcp->high_base << pcp->shift;
+	pcp->batch = pcp->batch_base << pcp->shift;
+	if (pcp->count > pcp->high) {
+		free_pcppages_bulk(zone, pcp->count - pcp->high, pcp);
+		pcp->count = pcp->high;
+	}
+	local_irq_restore(flags);
+}
+#endif
+
 /*
  * Drain pages of the indicated processor.
  *
@@ -1197,6 +1240,7 @@ void free_hot_cold_page(struct page *page, int cold)
 		list_add(&page->lru, &pcp->lists[migratetype]);
 	pcp->count++;
 	if (pcp->count >= pcp->high) {
+		pcp->drains++;
 		free_pcppages_bulk(zone, pcp->batch, pcp);
 		pcp->count -= pcp->batch;
 	}
@@ -1301,6 +1345,7 @@ again:
 		pcp = &this_cpu_ptr(zone->pageset)->pcp;
 		list = &pcp->lists[migratetype];
 		if (list_empty(list)) {
+			pcp->refills++;
 			pcp->count += rmqueue_bulk(zone, 0,
 					pcp->batch, list,
 					migratetype, cold);
@@ -2003,7 +2048,8 @@ __alloc_pages_slowpath(gfp_t gfp_mask, unsigned int order,
 		goto nopage;
 
 restart:
-	wake_all_kswapd(order, zonelist, high_zoneidx);
+	if (!(gfp_mask & __GFP_NO_KSWAPD))
+		wake_all_kswapd(order, zonelist, high_zoneidx);
 
 	/*
 	 * OK, we're below the kswapd watermark and have kicked background
@@ -2172,6 +2218,160 @@ __alloc_pages_nodemask(gfp_t gfp_mask, unsigned int order,
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/*
+ * Store a page allocated by __alloc_pages_bulk() in the caller's list, or
+ * in the first free slot of its array at or after *slot.
+ */
+static void bulk_add_page(struct page *page, struct list_head *page_list,
+			  struct page **page_array, unsigned long *slot)
+{
+	if (page_list) {
+		list_add_tail(&page->lru, page_list);
+		return;
+	}
+	while (page_array[*slot])
+		(*slot)++;
+	page_array[(*slot)++] = page;
+}
+
+/**
+ * __alloc_pages_bulk - allocate a number of order-0 pages in one go
+ * @gfp_mask: GFP flags for the allocation
+ * @zonelist: zonelist to allocate from
+ * @nodemask: nodes allowed, or NULL for all
+ * @nr_pages: number of pages wanted
+ * @page_list: list to add the pages to, or NULL
+ * @page_array: array to fill, or NULL
+ *
+ * The pages are taken from the pcp list of the first zone that has
+ * @nr_pages to spare above its low watermark, with interrupts disabled
+ * once for the whole batch.  When the list runs dry it is refilled with
+ * enough pages for the rest of the request, up to the list's high mark,
+ * under a single hold of zone->lock.
+ *
+ * Exactly one of @page_list and @page_array must be given.  Only the NULL
+ * entries of @page_array are filled.
+ *
+ * The batch path never enters reclaim.  If no zone can supply the batch,
+ * a single page is allocated through the normal allocator so that the
+ * caller still makes progress; it may then retry for the remainder.
+ *
+ * Returns the number of pages added to @page_list, or the number of
+ * populated entries in @page_array.
+ */
+unsigned long __alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+			nodemask_t *nodemask, unsigned long nr_pages,
+			struct list_head *page_list, struct page **page_array)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	int cold = !!(gfp_mask & __GFP_COLD);
+	struct zone *preferred_zone;
+	struct per_cpu_pages *pcp;
+	struct list_head *list;
+	struct page *page, *next;
+	struct zoneref *z;
+	struct zone *zone;
+	unsigned long nr_populated = 0;
+	unsigned long nr_wanted, nr_taken = 0;
+	unsigned long slot = 0;
+	unsigned long flags;
+	LIST_HEAD(taken);
+
+	if (page_array) {
+		unsigned long i;
+
+		for (i = 0; i < nr_pages; i++)
+			if (page_array[i])
+				nr_populated++;
+	}
+	nr_wanted = nr_pages - nr_populated;
+	if (!nr_wanted)
+		return nr_populated;
+
+	/* A single page gains nothing from the batch path */
+	if (nr_wanted == 1)
+		goto fallback;
+
+	gfp_mask &= gfp_allowed_mask;
+	if (should_fail_alloc_page(gfp_mask, 0))
+		goto fallback;
+	if (unlikely(!zonelist->_zonerefs->zone))
+		return nr_populated;
+
+	get_mems_allowed();
+	first_zones_zonelist(zonelist, high_zoneidx, nodemask, &preferred_zone);
+	if (!preferred_zone) {
+		put_mems_allowed();
+		return nr_populated;
+	}
+
+	for_each_zone_zonelist_nodemask(zone, z, zonelist,
+					high_zoneidx, nodemask) {
+		if (!cpuset_zone_allowed_softwall(zone,
+						  gfp_mask | __GFP_HARDWALL))
+			continue;
+		if (zone_watermark_ok(zone, 0, low_wmark_pages(zone) + nr_wanted,
+				      zone_idx(preferred_zone),
+				      ALLOC_WMARK_LOW | ALLOC_CPUSET))
+			goto found;
+	}
+	put_mems_allowed();
+	goto fallback;
+
+found:
+	local_irq_save(flags);
+	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list = &pcp->lists[migratetype];
+	while (nr_taken < nr_wanted) {
+		if (list_empty(list)) {
+			unsigned long count = nr_wanted - nr_taken;
+
+			count = clamp_t(unsigned long, count,
+					pcp->batch, max(pcp->high, pcp->batch));
+			pcp->refills++;
+			pcp->count += rmqueue_bulk(zone, 0, count, list,
+						   migratetype, cold);
+			if (unlikely(list_empty(list)))
+				break;
+		}
+
+		if (cold)
+			page = list_entry(list->prev, struct page, lru);
+		else
+			page = list_entry(list->next, struct page, lru);
+		list_move_tail(&page->lru, &taken);
+		pcp->count--;
+		nr_taken++;
+		zone_statistics(preferred_zone, zone);
+	}
+	__count_zone_vm_events(PGALLOC, zone, nr_taken);
+	local_irq_restore(flags);
+	put_mems_allowed();
+
+	list_for_each_entry_safe(page, next, &taken, lru) {
+		list_del(&page->lru);
+		VM_BUG_ON(bad_range(zone, page));
+		/* A bad page is leaked, as in buffered_rmqueue() */
+		if (prep_new_page(page, 0, gfp_mask))
+			continue;
+		trace_mm_page_alloc(page, 0, gfp_mask, migratetype);
+		bulk_add_page(page, page_list, page_array, &slot);
+		nr_populated++;
+	}
+	if (nr_taken)
+		return nr_populated;
+
+fallback:
+	page = __alloc_pages_nodemask(gfp_mask, 0, zonelist, nodemask);
+	if (page) {
+		bulk_add_page(page, page_list, page_array, &slot);
+		nr_populated++;
+	}
+	return nr_populated;
+}
+EXPORT_SYMBOL(__alloc_pages_bulk);
+
 /*
  * Common helper functions.
  */
@@ -3367,6 +3567,8 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->count = 0;
 	pcp->high = 6 * batch;
 	pcp->batch = max(1UL, 1 * batch);
+	pcp->high_base = pcp->high;
+	pcp->batch_base = pcp->batch;
 	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
 }
@@ -3386,6 +3588,9 @@ static void setup_pagelist_highmark(struct per_cpu_pageset *p,
 	pcp->batch = max(1UL, high/4);
 	if ((high/4) > (PAGE_SHIFT * 8))
 		pcp->batch = PAGE_SHIFT * 8;
+	/* A high mark set by hand is not autotuned */
+	pcp->high_base = 0;
+	pcp->shift = 0;
 }
 
 static __meminit void setup_zone_pageset(struct zone *zone)
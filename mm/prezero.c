@@ -0,0 +1,275 @@
+/*
+ * Pools of pre-zeroed pages for anonymous faults
+ *
+ * Zeroing a page takes a noticeable part of a first-touch anonymous fault.
+ * Each node with memory keeps a pool of pages that a per-node kernel
+ * thread, kprezerod, zeroes ahead of time with non-temporal stores while
+ * the node's cpus are otherwise idle.  Anonymous faults take a page from
+ * the pool of the node they run on before falling back to the page
+ * allocator.
+ *
+ * The pools are empty and the threads asleep until vm.prezero_pages is
+ * set.  Pages are only added to a pool while the node has plenty of free
+ * memory, and a shrinker hands them back to the allocator under pressure.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/highmem.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/cpuset.h>
+#include <linux/mempolicy.h>
+#include <linux/sysctl.h>
+#include <linux/module.h>
+#include <linux/prezero.h>
+
+struct prezero_pool {
+	spinlock_t		lock;
+	struct list_head	pages;
+	unsigned long		nr;
+	int			nid;
+	wait_queue_head_t	wait;
+	struct task_struct	*task;
+};
+
+static struct prezero_pool *prezero_pools[MAX_NUMNODES];
+
+/* Target number of pages in each node's pool; 0 disables the pools */
+unsigned long sysctl_prezero_pages __read_mostly;
+
+/*
+ * Pool fills do not sleep, stay on the node, never wake kswapd and fail
+ * quietly.  GFP_THISNODE alone would give all that on NUMA only: it is 0
+ * otherwise.
+ */
+#define PREZERO_GFP	((GFP_HIGHUSER_MOVABLE & ~__GFP_WAIT) | GFP_THISNODE | \
+			 __GFP_NOWARN | __GFP_NO_KSWAPD)
+
+/*
+ * Only fill a pool while its node has twice its high watermarks free, so
+ * that the pool never turns a comfortable node into one that reclaims,
+ * and while a zone the fill may use stays above its low watermark after
+ * the page is taken.  An atomic allocation that misses the low watermark
+ * would otherwise go on to the min watermark.
+ */
+static bool prezero_node_has_room(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	enum zone_type high_zoneidx = gfp_zone(PREZERO_GFP);
+	unsigned long free = 0, high = 0;
+	bool above_low = false;
+	int i;
+
+	for (i = 0; i < MAX_NR_ZONES; i++) {
+		struct zone *zone = &pgdat->node_zones[i];
+
+		if (!populated_zone(zone))
+			continue;
+		free += zone_page_state(zone, NR_FREE_PAGES);
+		high += high_wmark_pages(zone);
+		if (i <= high_zoneidx &&
+		    zone_watermark_ok(zone, 0, low_wmark_pages(zone),
+				      high_zoneidx, 0))
+			above_low = true;
+	}
+	return above_low && free > 2 * high;
+}
+
+static bool prezero_pool_wants_pages(struct prezero_pool *pool)
+{
+	return pool->nr < sysctl_prezero_pages;
+}
+
+static struct page *prezero_pool_take(struct prezero_pool *pool)
+{
+	struct page *page = NULL;
+
+	spin_lock(&pool->lock);
+	if (!list_empty(&pool->pages)) {
+		page = list_first_entry(&pool->pages, struct page, lru);
+		list_del(&page->lru);
+		pool->nr--;
+	}
+	spin_unlock(&pool->lock);
+	return page;
+}
+
+/* Give pages above @target back to the page allocator */
+static unsigned long prezero_pool_trim(struct prezero_pool *pool,
+				       unsigned long target)
+{
+	unsigned long freed = 0;
+	struct page *page;
+
+	while (pool->nr > target && (page = prezero_pool_take(pool))) {
+		__free_page(page);
+		freed++;
+	}
+	return freed;
+}
+
+static void prezero_pool_fill(struct prezero_pool *pool)
+{
+	while (prezero_pool_wants_pages(pool) && !kthread_should_stop()) {
+		struct page *page;
+
+		if (!prezero_node_has_room(pool->nid))
+			break;
+		page = alloc_pages_exact_node(pool->nid, PREZERO_GFP, 0);
+		if (!page)
+			break;
+		clear_highpage_nocache(page);
+
+		spin_lock(&pool->lock);
+		list_add_tail(&page->lru, &pool->pages);
+		pool->nr++;
+		spin_unlock(&pool->lock);
+		count_vm_event(PREZERO_FILL);
+
+		cond_resched();
+	}
+}
+
+static int prezero_thread(void *data)
+{
+	struct prezero_pool *pool = data;
+	const struct cpumask *cpumask = cpumask_of_node(pool->nid);
+	struct sched_param param = { .sched_priority = 0 };
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	/* Zero pages only with cpu time nobody else wants */
+	sched_setscheduler(current, SCHED_IDLE, &param);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(pool->wait,
+				     prezero_pool_wants_pages(pool) ||
+				     kthread_should_stop());
+		prezero_pool_fill(pool);
+
+		/*
+		 * Short of memory: stay off the wait queue for a while so
+		 * that every fault on an empty pool does not wake us.
+		 */
+		if (prezero_pool_wants_pages(pool))
+			schedule_timeout_interruptible(HZ);
+	}
+	return 0;
+}
+
+/**
+ * prezero_alloc_page - take a zeroed page for an anonymous fault
+ * @vma: the vma being faulted, or NULL if it has no policy of its own
+ *
+ * Returns a zeroed page from the pool of the local node, or NULL if the
+ * pool is empty or the fault must follow a memory policy.  The page is
+ * ready for use exactly as if it came from alloc_zeroed_user_highpage.
+ */
+struct page *prezero_alloc_page(struct vm_area_struct *vma)
+{
+	struct prezero_pool *pool;
+	struct page *page;
+	int nid;
+
+	if (!sysctl_prezero_pages)
+		return NULL;
+#ifdef CONFIG_NUMA
+	/* The pool only serves default, local placement */
+	if ((vma && vma->vm_policy) || current->mempolicy)
+		return NULL;
+#endif
+	nid = numa_node_id();
+	pool = prezero_pools[nid];
+	if (!pool || !node_isset(nid, cpuset_current_mems_allowed))
+		return NULL;
+
+	page = pool->nr ? prezero_pool_take(pool) : NULL;
+	count_vm_event(page ? PREZERO_HIT : PREZERO_MISS);
+
+	if (pool->nr < sysctl_prezero_pages / 2 &&
+	    waitqueue_active(&pool->wait))
+		wake_up(&pool->wait);
+	return page;
+}
+
+int prezero_sysctl_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int nid;
+	int ret;
+
+	ret = proc_doulongvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	for_each_node_state(nid, N_HIGH_MEMORY) {
+		struct prezero_pool *pool = prezero_pools[nid];
+
+		if (!pool)
+			continue;
+		prezero_pool_trim(pool, sysctl_prezero_pages);
+		wake_up(&pool->wait);
+	}
+	return 0;
+}
+
+static int prezero_shrink(struct shrinker *shrink, int nr_to_scan,
+			  gfp_t gfp_mask)
+{
+	unsigned long nr = 0;
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY) {
+		struct prezero_pool *pool = prezero_pools[nid];
+
+		if (!pool)
+			continue;
+		if (nr_to_scan > 0) {
+			unsigned long want = min_t(unsigned long,
+						   nr_to_scan, pool->nr);
+
+			nr_to_scan -= prezero_pool_trim(pool, pool->nr - want);
+		}
+		nr += pool->nr;
+	}
+	return min_t(unsigned long, nr, INT_MAX);
+}
+
+static struct shrinker prezero_shrinker = {
+	.shrink = prezero_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init prezero_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY) {
+		struct prezero_pool *pool;
+		struct task_struct *task;
+
+		pool = kzalloc_node(sizeof(*pool), GFP_KERNEL, nid);
+		if (!pool)
+			continue;
+		spin_lock_init(&pool->lock);
+		INIT_LIST_HEAD(&pool->pages);
+		init_waitqueue_head(&pool->wait);
+		pool->nid = nid;
+
+		task = kthread_run(prezero_thread, pool, "kprezerod%d", nid);
+		if (IS_ERR(task)) {
+			printk(KERN_ERR "prezero: failed to start thread "
+			       "for node %d\n", nid);
+			kfree(pool);
+			continue;
+		}
+		pool->task = task;
+		prezero_pools[nid] = pool;
+	}
+	register_shrinker(&prezero_shrinker);
+	return 0;
+}
+module_init(prezero_init)
@@ -109,7 +109,8 @@ EXPORT_SYMBOL(read_cache_pages);
 static int read_pages(struct address_space *mapping, struct file *filp,
 		struct list_head *pages, unsigned nr_pages)
 {
-	unsigned page_idx;
+	struct pagevec pvec;
+	unsigned page_idx, i, nr_added;
 	int ret;
 
 	if (mapping->a_ops->readpages) {
@@ -119,14 +120,20 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		goto out;
 	}
 
+	pagevec_init(&pvec, 0);
 	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
 		struct page *page = list_to_page(pages);
 		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
-			mapping->a_ops->readpage(filp, page);
+		if (pagevec_add(&pvec, page) && page_idx + 1 < nr_pages)
+			continue;
+		nr_added = pagevec_add_to_page_cache_lru(&pvec, mapping,
+							 GFP_KERNEL);
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			if (i < nr_added)
+				mapping->a_ops->readpage(filp, pvec.pages[i]);
+			page_cache_release(pvec.pages[i]);
 		}
-		page_cache_release(page);
+		pagevec_reinit(&pvec);
 	}
 	ret = 0;
 out:
@@ -150,6 +157,8 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	struct page *page;
 	unsigned long end_index;	/* The last page we want to read */
 	LIST_HEAD(page_pool);
+	LIST_HEAD(spare_pages);
+	gfp_t gfp = mapping_gfp_mask(mapping) | __GFP_COLD;
 	int page_idx;
 	int ret = 0;
 	loff_t isize = i_size_read(inode);
@@ -160,7 +169,9 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	end_index = ((isize - 1) >> PAGE_CACHE_SHIFT);
 
 	/*
-	 * Preallocate as many pages as we will need.
+	 * Preallocate as many pages as we will need.  They are taken from the
+	 * allocator in bulk, sized for the rest of the window the first time
+	 * a missing page is found; any left over are freed again below.
 	 */
 	for (page_idx = 0; page_idx < nr_to_read; page_idx++) {
 		pgoff_t page_offset = offset + page_idx;
@@ -174,15 +185,21 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		if (page)
 			continue;
 
-		page = page_cache_alloc_cold(mapping);
-		if (!page)
+		if (list_empty(&spare_pages) &&
+		    !__page_cache_alloc_bulk(gfp,
+				min_t(unsigned long, nr_to_read - page_idx,
+				      end_index - page_offset + 1),
+				&spare_pages))
 			break;
+		page = list_first_entry(&spare_pages, struct page, lru);
+		list_del(&page->lru);
 		page->index = page_offset;
 		list_add(&page->lru, &page_pool);
 		if (page_idx == nr_to_read - lookahead_size)
 			SetPageReadahead(page);
 		ret++;
 	}
+	put_pages_list(&spare_pages);
 
 	/*
 	 * Now start the IO.  We ignore I/O errors - if the page is not
@@ -230,6 +230,50 @@ static struct backing_dev_info shmem_backing_dev_info  __read_mostly = {
 static LIST_HEAD(shmem_swaplist);
 static DEFINE_MUTEX(shmem_swaplist_mutex);
 
+/*
+ * Used blocks and inodes are kept in percpu_counters.  Away from the limit
+ * percpu_counter_compare() decides from the approximate count and charging
+ * only touches this CPU's counter.  Near the limit charges are serialised
+ * by stat_lock and checked against the exact sum.  The fast path leaves
+ * one unit per online CPU of headroom for charges that have passed their
+ * check but not yet been counted; preemption is disabled across the two,
+ * so there is at most one such charge per CPU.
+ */
+static int shmem_charge_one(struct shmem_sb_info *sbinfo,
+			    struct percpu_counter *used, unsigned long limit)
+{
+	int ret = 0;
+
+	preempt_disable();
+	if (percpu_counter_compare(used,
+				   (s64)limit - num_online_cpus()) < 0) {
+		percpu_counter_inc(used);
+		goto out;
+	}
+
+	spin_lock(&sbinfo->stat_lock);
+	if (percpu_counter_sum(used) < limit)
+		percpu_counter_inc(used);
+	else
+		ret = -ENOSPC;
+	spin_unlock(&sbinfo->stat_lock);
+out:
+	preempt_enable();
+	return ret;
+}
+
+static int shmem_charge_block(struct inode *inode, unsigned long limit)
+{
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+
+	if (shmem_charge_one(sbinfo, &sbinfo->used_blocks, limit))
+		return -ENOSPC;
+	spin_lock(&inode->i_lock);
+	inode->i_blocks += BLOCKS_PER_PAGE;
+	spin_unlock(&inode->i_lock);
+	return 0;
+}
+
 static void shmem_free_blocks(struct inode *inode, long pages)
 {
 	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
@@ -244,26 +288,17 @@ static void shmem_free_blocks(struct inode *inode, long pages)
 static int shmem_reserve_inode(struct super_block *sb)
 {
 	struct shmem_sb_info *sbinfo = SHMEM_SB(sb);
-	if (sbinfo->max_inodes) {
-		spin_lock(&sbinfo->stat_lock);
-		if (!sbinfo->free_inodes) {
-			spin_unlock(&sbinfo->stat_lock);
-			return -ENOSPC;
-		}
-		sbinfo->free_inodes--;
-		spin_unlock(&sbinfo->stat_lock);
-	}
+	if (sbinfo->max_inodes)
+		return shmem_charge_one(sbinfo, &sbinfo->used_inodes,
+					sbinfo->max_inodes);
 	return 0;
 }
 
 static void shmem_free_inode(struct super_block *sb)
 {
 	struct shmem_sb_info *sbinfo = SHMEM_SB(sb);
-	if (sbinfo->max_inodes) {
-		spin_lock(&sbinfo->stat_lock);
-		sbinfo->free_inodes++;
-		spin_unlock(&sbinfo->stat_lock);
-	}
+	if (sbinfo->max_inodes)
+		percpu_counter_dec(&sbinfo->used_inodes);
 }
 
 /**
@@ -421,14 +456,9 @@ static swp_entry_t *shmem_swp_alloc(struct shmem_inode_info *info, unsigned long
 		 * page (and perhaps indirect index pages) yet to allocate:
 		 * a waste to allocate index if we cannot allocate data.
 		 */
-		if (sbinfo->max_blocks) {
-			if (percpu_counter_compare(&sbinfo->used_blocks, (sbinfo->max_blocks - 1)) > 0)
-				return ERR_PTR(-ENOSPC);
-			percpu_counter_inc(&sbinfo->used_blocks);
-			spin_lock(&inode->i_lock);
-			inode->i_blocks += BLOCKS_PER_PAGE;
-			spin_unlock(&inode->i_lock);
-		}
+		if (sbinfo->max_blocks &&
+		    shmem_charge_block(inode, sbinfo->max_blocks - 1))
+			return ERR_PTR(-ENOSPC);
 
 		spin_unlock(&info->lock);
 		page = shmem_dir_alloc(mapping_gfp_mask(inode->i_mapping));
@@ -1399,16 +1429,17 @@ repeat:
 		shmem_swp_unmap(entry);
 		sbinfo = SHMEM_SB(inode->i_sb);
 		if (sbinfo->max_blocks) {
-			if ((percpu_counter_compare(&sbinfo->used_blocks, sbinfo->max_blocks) > 0) ||
-			    shmem_acct_block(info->flags)) {
+			if (shmem_acct_block(info->flags)) {
+				spin_unlock(&info->lock);
+				error = -ENOSPC;
+				goto failed;
+			}
+			if (shmem_charge_block(inode, sbinfo->max_blocks)) {
+				shmem_unacct_blocks(info->flags, 1);
 				spin_unlock(&info->lock);
 				error = -ENOSPC;
 				goto failed;
 			}
-			percpu_counter_inc(&sbinfo->used_blocks);
-			spin_lock(&inode->i_lock);
-			inode->i_blocks += BLOCKS_PER_PAGE;
-			spin_unlock(&inode->i_lock);
 		} else if (shmem_acct_block(info->flags)) {
 			spin_unlock(&info->lock);
 			error = -ENOSPC;
@@ -1826,12 +1857,25 @@ static int shmem_statfs(struct dentry *dentry, struct kstatfs *buf)
 	}
 	if (sbinfo->max_inodes) {
 		buf->f_files = sbinfo->max_inodes;
-		buf->f_ffree = sbinfo->free_inodes;
+		buf->f_ffree =
+				sbinfo->max_inodes - percpu_counter_sum(&sbinfo->used_inodes);
 	}
 	/* else leave those fields 0 like simple_statfs */
 	return 0;
 }
 
+/*
+ * Create and unlink run without the directory's i_mutex (FS_PARALLEL_DIROPS),
+ * so the directory's size and times are updated under its i_lock instead.
+ */
+static void shmem_dir_change(struct inode *dir, int entries)
+{
+	spin_lock(&dir->i_lock);
+	i_size_write(dir, dir->i_size + entries * BOGO_DIRENT_SIZE);
+	dir->i_ctime = dir->i_mtime = CURRENT_TIME;
+	spin_unlock(&dir->i_lock);
+}
+
 /*
  * File creation. Allocate an inode, and we're done..
  */
@@ -1860,8 +1904,7 @@ shmem_mknod(struct inode *dir, struct dentry *dentry, int mode, dev_t dev)
 #else
 		error = 0;
 #endif
-		dir->i_size += BOGO_DIRENT_SIZE;
-		dir->i_ctime = dir->i_mtime = CURRENT_TIME;
+		shmem_dir_change(dir, 1);
 		d_instantiate(dentry, inode);
 		dget(dentry); /* Extra count - pin the dentry in core */
 	}
@@ -1901,8 +1944,8 @@ static int shmem_link(struct dentry *old_dentry, struct inode *dir, struct dentr
 	if (ret)
 		goto out;
 
-	dir->i_size += BOGO_DIRENT_SIZE;
-	inode->i_ctime = dir->i_ctime = dir->i_mtime = CURRENT_TIME;
+	shmem_dir_change(dir, 1);
+	inode->i_ctime = dir->i_ctime;
 	inc_nlink(inode);
 	ihold(inode);	/* New dentry reference */
 	dget(dentry);		/* Extra pinning count for the created dentry */
@@ -1918,8 +1961,8 @@ static int shmem_unlink(struct inode *dir, struct dentry *dentry)
 	if (inode->i_nlink > 1 && !S_ISDIR(inode->i_mode))
 		shmem_free_inode(inode->i_sb);
 
-	dir->i_size -= BOGO_DIRENT_SIZE;
-	inode->i_ctime = dir->i_ctime = dir->i_mtime = CURRENT_TIME;
+	shmem_dir_change(dir, -1);
+	inode->i_ctime = dir->i_ctime;
 	drop_nlink(inode);
 	dput(dentry);	/* Undo the count from "create" - this does all the work */
 	return 0;
@@ -1958,11 +2001,9 @@ static int shmem_rename(struct inode *old_dir, struct dentry *old_dentry, struct
 		inc_nlink(new_dir);
 	}
 
-	old_dir->i_size -= BOGO_DIRENT_SIZE;
-	new_dir->i_size += BOGO_DIRENT_SIZE;
-	old_dir->i_ctime = old_dir->i_mtime =
-	new_dir->i_ctime = new_dir->i_mtime =
-	inode->i_ctime = CURRENT_TIME;
+	shmem_dir_change(old_dir, -1);
+	shmem_dir_change(new_dir, 1);
+	inode->i_ctime = new_dir->i_ctime;
 	return 0;
 }
 
@@ -2014,8 +2055,7 @@ static int shmem_symlink(struct inode *dir, struct dentry *dentry, const char *s
 		unlock_page(page);
 		page_cache_release(page);
 	}
-	dir->i_size += BOGO_DIRENT_SIZE;
-	dir->i_ctime = dir->i_mtime = CURRENT_TIME;
+	shmem_dir_change(dir, 1);
 	d_instantiate(dentry, inode);
 	dget(dentry);
 	return 0;
@@ -2276,7 +2316,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 		return error;
 
 	spin_lock(&sbinfo->stat_lock);
-	inodes = sbinfo->max_inodes - sbinfo->free_inodes;
+	inodes = percpu_counter_sum(&sbinfo->used_inodes);
 	if (percpu_counter_compare(&sbinfo->used_blocks, config.max_blocks) > 0)
 		goto out;
 	if (config.max_inodes < inodes)
@@ -2295,7 +2335,6 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	error = 0;
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
-	sbinfo->free_inodes = config.max_inodes - inodes;
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
@@ -2329,6 +2368,7 @@ static void shmem_put_super(struct super_block *sb)
 	struct shmem_sb_info *sbinfo = SHMEM_SB(sb);
 
 	percpu_counter_destroy(&sbinfo->used_blocks);
+	percpu_counter_destroy(&sbinfo->used_inodes);
 	kfree(sbinfo);
 	sb->s_fs_info = NULL;
 }
@@ -2373,7 +2413,8 @@ int shmem_fill_super(struct super_block *sb, void *data, int silent)
 	spin_lock_init(&sbinfo->stat_lock);
 	if (percpu_counter_init(&sbinfo->used_blocks, 0))
 		goto failed;
-	sbinfo->free_inodes = sbinfo->max_inodes;
+	if (percpu_counter_init(&sbinfo->used_inodes, 0))
+		goto failed;
 
 	sb->s_maxbytes = SHMEM_MAX_BYTES;
 	sb->s_blocksize = PAGE_CACHE_SIZE;
@@ -2415,13 +2456,21 @@ static struct inode *shmem_alloc_inode(struct super_block *sb)
 	return &p->vfs_inode;
 }
 
+static void shmem_i_callback(struct rcu_head *head)
+{
+	struct inode *inode = container_of(head, struct inode, i_rcu);
+
+	INIT_LIST_HEAD(&inode->i_dentry);
+	kmem_cache_free(shmem_inode_cachep, SHMEM_I(inode));
+}
+
 static void shmem_destroy_inode(struct inode *inode)
 {
 	if ((inode->i_mode & S_IFMT) == S_IFREG) {
 		/* only struct inode is valid if it's an inline symlink */
 		mpol_free_shared_policy(&SHMEM_I(inode)->policy);
 	}
-	kmem_cache_free(shmem_inode_cachep, SHMEM_I(inode));
+	call_rcu(&inode->i_rcu, shmem_i_callback);
 }
 
 static void init_once(void *foo)
@@ -2531,6 +2580,7 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+	.map_pages	= filemap_map_pages,
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -2549,6 +2599,7 @@ static struct file_system_type tmpfs_fs_type = {
 	.name		= "tmpfs",
 	.mount		= shmem_mount,
 	.kill_sb	= kill_litter_super,
+	.fs_flags	= FS_RCU_INODES | FS_PARALLEL_DIROPS,
 };
 
 int __init init_tmpfs(void)
@@ -2576,6 +2627,7 @@ int __init init_tmpfs(void)
 		printk(KERN_ERR "Could not kern_mount tmpfs\n");
 		goto out1;
 	}
+	mnt_make_longterm(shm_mnt);
 	return 0;
 
 out1:
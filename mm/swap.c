@@ -37,8 +37,29 @@
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
-static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
+/*
+ * Pages headed for the LRU are gathered per cpu and spliced onto the lists
+ * under a single hold of each zone's lru_lock.  A batch starts out at
+ * PAGEVEC_SIZE pages; every time a flush finds lru_lock contended it doubles,
+ * up to LRU_ADD_BATCH_MAX, and it halves again after LRU_ADD_BATCH_DECAY
+ * flushes in a row that got the lock without waiting.  Quiet machines keep
+ * pages off the LRU for no longer than before, busy ones go to the lock
+ * less often.
+ */
+#define LRU_ADD_BATCH_SHIFT_MAX	2
+#define LRU_ADD_BATCH_MAX	(PAGEVEC_SIZE << LRU_ADD_BATCH_SHIFT_MAX)
+#define LRU_ADD_BATCH_DECAY	16
+
+struct lru_add_batch {
+	unsigned int nr;
+	unsigned int shift;		/* batch is PAGEVEC_SIZE << shift */
+	unsigned int uncontended;	/* flushes since lru_lock was busy */
+	struct page *pages[LRU_ADD_BATCH_MAX];
+};
+
+static DEFINE_PER_CPU(struct lru_add_batch[NR_LRU_LISTS], lru_add_batches);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, activate_page_pvecs);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -172,14 +193,8 @@ static void update_page_reclaim_stat(struct zone *zone, struct page *page,
 		memcg_reclaim_stat->recent_rotated[file]++;
 }
 
-/*
- * FIXME: speed this up?
- */
-void activate_page(struct page *page)
+static void __activate_page(struct zone *zone, struct page *page)
 {
-	struct zone *zone = page_zone(page);
-
-	spin_lock_irq(&zone->lru_lock);
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 		int file = page_is_file_cache(page);
 		int lru = page_lru_base_type(page);
@@ -192,7 +207,51 @@ void activate_page(struct page *page)
 
 		update_page_reclaim_stat(zone, page, file, 1);
 	}
-	spin_unlock_irq(&zone->lru_lock);
+}
+
+/*
+ * Activate the pages queued by activate_page(), taking each zone's
+ * lru_lock once for all of its pages, then drop the queue's references.
+ */
+static void pagevec_activate(struct pagevec *pvec)
+{
+	int i;
+	struct zone *zone = NULL;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+		__activate_page(zone, page);
+	}
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	pagevec_reinit(pvec);
+}
+
+/*
+ * Page activation is queued per cpu, like LRU addition, so that
+ * mark_page_accessed() on a hot file does not take lru_lock for every page.
+ * The page stays on the inactive list until the queue is drained; a second
+ * activate_page() on it in the meantime is harmless.
+ */
+void activate_page(struct page *page)
+{
+	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
+		struct pagevec *pvec = &get_cpu_var(activate_page_pvecs);
+
+		page_cache_get(page);
+		if (!pagevec_add(pvec, page))
+			pagevec_activate(pvec);
+		put_cpu_var(activate_page_pvecs);
+	}
 }
 
 /*
@@ -215,14 +274,79 @@ void mark_page_accessed(struct page *page)
 
 EXPORT_SYMBOL(mark_page_accessed);
 
+/*
+ * Put @nr pages on @lru.  Pages are taken a zone at a time so that each
+ * zone's lru_lock is acquired only once, however the zones are interleaved
+ * in @pages; the array is reordered in the process.  Returns true if any
+ * lru_lock was found contended.
+ */
+static bool lru_add_pages(struct page **pages, int nr, enum lru_list lru)
+{
+	int active = is_active_lru(lru);
+	int file = is_file_lru(lru);
+	bool contended = false;
+	int start = 0;
+
+	VM_BUG_ON(is_unevictable_lru(lru));
+
+	while (start < nr) {
+		struct zone *zone = page_zone(pages[start]);
+		int i;
+
+		if (!spin_trylock_irq(&zone->lru_lock)) {
+			contended = true;
+			spin_lock_irq(&zone->lru_lock);
+		}
+		for (i = start; i < nr; i++) {
+			struct page *page = pages[i];
+
+			if (page_zone(page) != zone)
+				continue;
+
+			VM_BUG_ON(PageActive(page));
+			VM_BUG_ON(PageUnevictable(page));
+			VM_BUG_ON(PageLRU(page));
+			SetPageLRU(page);
+			if (active)
+				SetPageActive(page);
+			update_page_reclaim_stat(zone, page, file, active);
+			add_page_to_lru_list(zone, page, lru);
+
+			pages[i] = pages[start];
+			pages[start++] = page;
+		}
+		spin_unlock_irq(&zone->lru_lock);
+	}
+	return contended;
+}
+
+/*
+ * Flush a per-cpu LRU batch and resize it for next time.  Called with
+ * preemption disabled, or for a cpu that is already dead.
+ */
+static void lru_add_batch_flush(struct lru_add_batch *lb, enum lru_list lru)
+{
+	if (lru_add_pages(lb->pages, lb->nr, lru)) {
+		if (lb->shift < LRU_ADD_BATCH_SHIFT_MAX)
+			lb->shift++;
+		lb->uncontended = 0;
+	} else if (lb->shift && ++lb->uncontended >= LRU_ADD_BATCH_DECAY) {
+		lb->shift--;
+		lb->uncontended = 0;
+	}
+	release_pages(lb->pages, lb->nr, 0);
+	lb->nr = 0;
+}
+
 void __lru_cache_add(struct page *page, enum lru_list lru)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvecs)[lru];
+	struct lru_add_batch *lb = &get_cpu_var(lru_add_batches)[lru];
 
 	page_cache_get(page);
-	if (!pagevec_add(pvec, page))
-		____pagevec_lru_add(pvec, lru);
-	put_cpu_var(lru_add_pvecs);
+	lb->pages[lb->nr++] = page;
+	if (lb->nr >= PAGEVEC_SIZE << lb->shift)
+		lru_add_batch_flush(lb, lru);
+	put_cpu_var(lru_add_batches);
 }
 EXPORT_SYMBOL(__lru_cache_add);
 
@@ -273,14 +397,15 @@ void add_page_to_unevictable_list(struct page *page)
  */
 static void drain_cpu_pagevecs(int cpu)
 {
-	struct pagevec *pvecs = per_cpu(lru_add_pvecs, cpu);
+	struct lru_add_batch *batches = per_cpu(lru_add_batches, cpu);
 	struct pagevec *pvec;
 	int lru;
 
 	for_each_lru(lru) {
-		pvec = &pvecs[lru - LRU_BASE];
-		if (pagevec_count(pvec))
-			____pagevec_lru_add(pvec, lru);
+		struct lru_add_batch *lb = &batches[lru - LRU_BASE];
+
+		if (lb->nr)
+			lru_add_batch_flush(lb, lru);
 	}
 
 	pvec = &per_cpu(lru_rotate_pvecs, cpu);
@@ -292,6 +417,10 @@ static void drain_cpu_pagevecs(int cpu)
 		pagevec_move_tail(pvec);
 		local_irq_restore(flags);
 	}
+
+	pvec = &per_cpu(activate_page_pvecs, cpu);
+	if (pagevec_count(pvec))
+		pagevec_activate(pvec);
 }
 
 void lru_add_drain(void)
@@ -405,36 +534,7 @@ EXPORT_SYMBOL(__pagevec_release);
  */
 void ____pagevec_lru_add(struct pagevec *pvec, enum lru_list lru)
 {
-	int i;
-	struct zone *zone = NULL;
-
-	VM_BUG_ON(is_unevictable_lru(lru));
-
-	for (i = 0; i < pagevec_count(pvec); i++) {
-		struct page *page = pvec->pages[i];
-		struct zone *pagezone = page_zone(page);
-		int file;
-		int active;
-
-		if (pagezone != zone) {
-			if (zone)
-				spin_unlock_irq(&zone->lru_lock);
-			zone = pagezone;
-			spin_lock_irq(&zone->lru_lock);
-		}
-		VM_BUG_ON(PageActive(page));
-		VM_BUG_ON(PageUnevictable(page));
-		VM_BUG_ON(PageLRU(page));
-		SetPageLRU(page);
-		active = is_active_lru(lru);
-		file = is_file_lru(lru);
-		if (active)
-			SetPageActive(page);
-		update_page_reclaim_stat(zone, page, file, active);
-		add_page_to_lru_list(zone, page, lru);
-	}
-	if (zone)
-		spin_unlock_irq(&zone->lru_lock);
+	lru_add_pages(pvec->pages, pagevec_count(pvec), lru);
 	release_pages(pvec->pages, pvec->nr, pvec->cold);
 	pagevec_reinit(pvec);
 }
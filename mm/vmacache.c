@@ -0,0 +1,82 @@
+/*
+ * mm/vmacache.c
+ *
+ * Per-thread vma lookup cache, see include/linux/vmacache.h.
+ */
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/vmacache.h>
+
+/*
+ * Only the owning thread ever reads or writes its cache.  Lookups on
+ * behalf of another mm (get_user_pages() from ptrace, or a kernel
+ * thread that borrowed the mm with use_mm()) simply bypass it.
+ */
+static inline int vmacache_valid_mm(struct mm_struct *mm)
+{
+	return current->mm == mm && !(current->flags & PF_KTHREAD);
+}
+
+void vmacache_update(unsigned long addr, struct vm_area_struct *newvma)
+{
+	if (vmacache_valid_mm(newvma->vm_mm))
+		current->vmacache[VMACACHE_HASH(addr)] = newvma;
+}
+
+static int vmacache_valid(struct mm_struct *mm)
+{
+	struct task_struct *curr;
+	u64 seqnum;
+
+	if (!vmacache_valid_mm(mm))
+		return 0;
+
+	curr = current;
+	seqnum = ACCESS_ONCE(mm->vmacache_seqnum);
+	if (seqnum != curr->vmacache_seqnum) {
+		/*
+		 * A vma left the tree since this thread last looked: any
+		 * entry may be stale, start over.
+		 */
+		curr->vmacache_seqnum = seqnum;
+		vmacache_flush(curr);
+		return 0;
+	}
+	return 1;
+}
+
+struct vm_area_struct *vmacache_find(struct mm_struct *mm, unsigned long addr)
+{
+	int i;
+
+	if (!vmacache_valid(mm))
+		return NULL;
+
+	for (i = 0; i < VMACACHE_SIZE; i++) {
+		struct vm_area_struct *vma = current->vmacache[i];
+
+		if (vma && vma->vm_start <= addr && vma->vm_end > addr)
+			return vma;
+	}
+	return NULL;
+}
+
+#ifndef CONFIG_MMU
+struct vm_area_struct *vmacache_find_exact(struct mm_struct *mm,
+					   unsigned long start,
+					   unsigned long end)
+{
+	int i;
+
+	if (!vmacache_valid(mm))
+		return NULL;
+
+	for (i = 0; i < VMACACHE_SIZE; i++) {
+		struct vm_area_struct *vma = current->vmacache[i];
+
+		if (vma && vma->vm_start == start && vma->vm_end == end)
+			return vma;
+	}
+	return NULL;
+}
+#endif
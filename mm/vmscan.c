@@ -1224,6 +1224,28 @@ static int too_many_isolated(struct zone *zone, int file,
 	return isolated > inactive;
 }
 
+/*
+ * Our reference was the last one on a page we just put back on the LRU:
+ * take it off again and queue it on @pages_to_free, to be freed once
+ * lru_lock is dropped.  Releasing the pages under the lock like this,
+ * rather than through a pagevec, saves dropping and retaking lru_lock
+ * every PAGEVEC_SIZE pages.
+ */
+static void putback_free_page(struct zone *zone, struct page *page,
+			      enum lru_list lru, struct list_head *pages_to_free)
+{
+	__ClearPageLRU(page);
+	__ClearPageActive(page);
+	del_page_from_lru_list(zone, page, lru);
+
+	if (unlikely(PageCompound(page))) {
+		spin_unlock_irq(&zone->lru_lock);
+		(*get_compound_page_dtor(page))(page);
+		spin_lock_irq(&zone->lru_lock);
+	} else
+		list_add(&page->lru, pages_to_free);
+}
+
 /*
  * TODO: Try merging with migrations version of putback_lru_pages
  */
@@ -1233,11 +1255,9 @@ putback_lru_pages(struct zone *zone, struct scan_control *sc,
 				struct list_head *page_list)
 {
 	struct page *page;
-	struct pagevec pvec;
+	LIST_HEAD(pages_to_free);
 	struct zone_reclaim_stat *reclaim_stat = get_reclaim_stat(zone, sc);
 
-	pagevec_init(&pvec, 1);
-
 	/*
 	 * Put back any unfreeable pages.
 	 */
@@ -1260,17 +1280,14 @@ putback_lru_pages(struct zone *zone, struct scan_control *sc,
 			int file = is_file_lru(lru);
 			reclaim_stat->recent_rotated[file]++;
 		}
-		if (!pagevec_add(&pvec, page)) {
-			spin_unlock_irq(&zone->lru_lock);
-			__pagevec_release(&pvec);
-			spin_lock_irq(&zone->lru_lock);
-		}
+		if (put_page_testzero(page))
+			putback_free_page(zone, page, lru, &pages_to_free);
 	}
 	__mod_zone_page_state(zone, NR_ISOLATED_ANON, -nr_anon);
 	__mod_zone_page_state(zone, NR_ISOLATED_FILE, -nr_file);
 
 	spin_unlock_irq(&zone->lru_lock);
-	pagevec_release(&pvec);
+	free_page_list(&pages_to_free);
 }
 
 static noinline_for_stack void update_isolated_counts(struct zone *zone,
@@ -1450,14 +1467,12 @@ shrink_inactive_list(unsigned long nr_to_scan, struct zone *zone,
 
 static void move_active_pages_to_lru(struct zone *zone,
 				     struct list_head *list,
+				     struct list_head *pages_to_free,
 				     enum lru_list lru)
 {
 	unsigned long pgmoved = 0;
-	struct pagevec pvec;
 	struct page *page;
 
-	pagevec_init(&pvec, 1);
-
 	while (!list_empty(list)) {
 		page = lru_to_page(list);
 
@@ -1468,13 +1483,8 @@ static void move_active_pages_to_lru(struct zone *zone,
 		mem_cgroup_add_lru_list(page, lru);
 		pgmoved++;
 
-		if (!pagevec_add(&pvec, page) || list_empty(list)) {
-			spin_unlock_irq(&zone->lru_lock);
-			if (buffer_heads_over_limit)
-				pagevec_strip(&pvec);
-			__pagevec_release(&pvec);
-			spin_lock_irq(&zone->lru_lock);
-		}
+		if (put_page_testzero(page))
+			putback_free_page(zone, page, lru, pages_to_free);
 	}
 	__mod_zone_page_state(zone, NR_LRU_BASE + lru, pgmoved);
 	if (!is_active_lru(lru))
@@ -1490,6 +1500,7 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 	LIST_HEAD(l_hold);	/* The pages which were snipped off */
 	LIST_HEAD(l_active);
 	LIST_HEAD(l_inactive);
+	LIST_HEAD(l_free);
 	struct page *page;
 	struct zone_reclaim_stat *reclaim_stat = get_reclaim_stat(zone, sc);
 	unsigned long nr_rotated = 0;
@@ -1533,6 +1544,14 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 			continue;
 		}
 
+		if (unlikely(buffer_heads_over_limit)) {
+			if (page_has_private(page) && trylock_page(page)) {
+				if (page_has_private(page))
+					try_to_release_page(page, 0);
+				unlock_page(page);
+			}
+		}
+
 		if (page_referenced(page, 0, sc->mem_cgroup, &vm_flags)) {
 			nr_rotated++;
 			/*
@@ -1566,12 +1585,14 @@ static void shrink_active_list(unsigned long nr_pages, struct zone *zone,
 	 */
 	reclaim_stat->recent_rotated[file] += nr_rotated;
 
-	move_active_pages_to_lru(zone, &l_active,
+	move_active_pages_to_lru(zone, &l_active, &l_free,
 						LRU_ACTIVE + file * LRU_FILE);
-	move_active_pages_to_lru(zone, &l_inactive,
+	move_active_pages_to_lru(zone, &l_inactive, &l_free,
 						LRU_BASE   + file * LRU_FILE);
 	__mod_zone_page_state(zone, NR_ISOLATED_ANON + file, -nr_taken);
 	spin_unlock_irq(&zone->lru_lock);
+
+	free_page_list(&l_free);
 }
 
 #ifdef CONFIG_SWAP
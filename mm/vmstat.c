@@ -338,6 +338,8 @@ void refresh_cpu_vm_stats(int cpu)
 #endif
 			}
 		cond_resched();
+
+		pcp_autotune(zone, &p->pcp);
 #ifdef CONFIG_NUMA
 		/*
 		 * Deal with draining the remote pageset of this
@@ -750,6 +752,7 @@ static const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_dirtied",
 	"nr_written",
+	"nr_anon_transparent_hugepages",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -776,6 +779,17 @@ static const char * const vmstat_text[] = {
 
 	"pgfault",
 	"pgmajfault",
+	"fault_around",
+	"fault_around_ptes",
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"spf_fault",
+	"spf_abort",
+#endif
+#ifdef CONFIG_PREZERO_PAGES
+	"prezero_hit",
+	"prezero_miss",
+	"prezero_fill",
+#endif
 
 	TEXTS_FOR_ZONES("pgrefill")
 	TEXTS_FOR_ZONES("pgsteal")
@@ -818,6 +832,14 @@ static const char * const vmstat_text[] = {
 	"unevictable_pgs_cleared",
 	"unevictable_pgs_stranded",
 	"unevictable_pgs_mlockfreed",
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	"thp_fault_alloc",
+	"thp_fault_fallback",
+	"thp_collapse_alloc",
+	"thp_collapse_alloc_failed",
+	"thp_split",
+#endif
 #endif
 };
 
@@ -513,6 +513,21 @@ int security_inode_permission(struct inode *inode, int mask)
 	return security_ops->inode_permission(inode, mask);
 }
 
+/*
+ * RCU path walking must not block, and a module's ->inode_permission()
+ * may (e.g. to audit a denial).  Only the default hook is known to be
+ * safe; with anything else the walk falls back to taking references.
+ */
+int security_inode_exec_permission_rcu(struct inode *inode)
+{
+	if (unlikely(IS_PRIVATE(inode)))
+		return 0;
+	if (security_ops->inode_permission !=
+	    default_security_ops.inode_permission)
+		return -ECHILD;
+	return 0;
+}
+
 int security_inode_setattr(struct dentry *dentry, struct iattr *attr)
 {
 	if (unlikely(IS_PRIVATE(dentry->d_inode)))
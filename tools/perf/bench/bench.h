@@ -3,7 +3,19 @@
 
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
+extern int bench_sched_fork(int argc, const char **argv, const char *prefix);
+extern int bench_sched_spawn(int argc, const char **argv, const char *prefix);
+extern int bench_sched_exec(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_fault(int argc, const char **argv, const char *prefix);
+extern int bench_mem_random(int argc, const char **argv, const char *prefix);
+extern int bench_mem_fork(int argc, const char **argv, const char *prefix);
+extern int bench_fs_stat(int argc, const char **argv, const char *prefix);
+extern int bench_fs_create(int argc, const char **argv, const char *prefix);
+extern int bench_fs_fdalloc(int argc, const char **argv, const char *prefix);
+extern int bench_futex_hash(int argc, const char **argv, const char *prefix);
+extern int bench_futex_wake(int argc, const char **argv, const char *prefix);
+extern int bench_futex_requeue(int argc, const char **argv, const char *prefix);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
@@ -0,0 +1,116 @@
+/*
+ *
+ * fs-create.c
+ *
+ * create: Benchmark for file create/write/unlink scalability
+ *
+ * Each worker process repeatedly creates a file of its own in one shared
+ * directory, writes a few pages to it and unlinks it again.  Run on a
+ * tmpfs mount (the default is /dev/shm) this stresses the per-superblock
+ * block and inode accounting as well as the directory itself.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "workers.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define LOOPS_DEFAULT 10000
+#define PAGES_DEFAULT 4
+
+static int loops = LOOPS_DEFAULT;
+static int nr_pages = PAGES_DEFAULT;
+static int nr_procs;
+static const char *dir = "/dev/shm";
+
+static const struct option options[] = {
+	OPT_INTEGER('p', "procs", &nr_procs,
+		    "Specify number of worker processes (default: online CPUs)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of loops per worker"),
+	OPT_INTEGER('s', "pages", &nr_pages,
+		    "Specify number of pages written to each file"),
+	OPT_STRING('d', "dir", &dir, "dir",
+		   "Directory to create the test files in"),
+	OPT_END()
+};
+
+static const char * const bench_fs_create_usage[] = {
+	"perf bench fs create <options>",
+	NULL
+};
+
+static char base[PATH_MAX];
+static char *buf;
+static size_t len;
+
+static int worker(int id)
+{
+	char name[PATH_MAX];
+	int i, fd;
+
+	for (i = 0; i < loops; i++) {
+		snprintf(name, sizeof(name), "%s/w%d.%d", base, id, i);
+
+		fd = open(name, O_CREAT | O_EXCL | O_WRONLY, 0600);
+		if (fd < 0)
+			return 1;
+		if (write(fd, buf, len) != (ssize_t)len)
+			return 1;
+		close(fd);
+		if (unlink(name))
+			return 1;
+	}
+	return 0;
+}
+
+int bench_fs_create(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	struct timeval elapsed;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_create_usage, 0);
+
+	if (nr_procs <= 0)
+		nr_procs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_pages < 0)
+		nr_pages = 0;
+
+	len = nr_pages * sysconf(_SC_PAGESIZE);
+	buf = malloc(len);
+	if (!buf)
+		die("malloc: %s", strerror(errno));
+	memset(buf, 0x5a, len);
+
+	snprintf(base, sizeof(base), "%s/perf-bench-create.%d", dir, getpid());
+	if (mkdir(base, 0700))
+		die("mkdir %s: %s", base, strerror(errno));
+
+	run_worker_procs(nr_procs, worker, &elapsed);
+	rmdir(base);
+	free(buf);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d processes doing %d create/write/unlink loops "
+		       "of %d pages each\n\n", nr_procs, loops, nr_pages);
+	/* one create+write+unlink cycle per loop */
+	print_workers_result(&elapsed, nr_procs,
+			     (unsigned long long)loops * nr_procs, "op");
+
+	return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ *
+ * fs-fdalloc.c
+ *
+ * fdalloc: Benchmark for file descriptor allocation scalability
+ *
+ * Worker threads of one process, and so sharing one file descriptor
+ * table, repeatedly create a socket and close it again.  Besides the
+ * socket setup this is mostly fd allocation and release in the shared
+ * table, as done by threaded servers accepting connections.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "workers.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#define LOOPS_DEFAULT 100000
+
+static int loops = LOOPS_DEFAULT;
+static int nr_threads;
+static int nr_open;
+static bool use_pipe;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of worker threads (default: online CPUs)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of loops per thread"),
+	OPT_INTEGER('o', "open", &nr_open,
+		    "Specify number of descriptors kept open during the run"),
+	OPT_BOOLEAN('P', "pipe", &use_pipe,
+		    "Use pipe() instead of socket()"),
+	OPT_END()
+};
+
+static const char * const bench_fs_fdalloc_usage[] = {
+	"perf bench fs fdalloc <options>",
+	NULL
+};
+
+static int worker(int id __used)
+{
+	int fds[2];
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		if (use_pipe) {
+			if (pipe(fds))
+				return 1;
+			close(fds[1]);
+		} else {
+			fds[0] = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (fds[0] < 0)
+				return 1;
+		}
+		close(fds[0]);
+	}
+	return 0;
+}
+
+int bench_fs_fdalloc(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval elapsed;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_fdalloc_usage, 0);
+
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* a populated table makes the lowest free descriptor harder to find */
+	for (i = 0; i < nr_open; i++)
+		if (dup(0) < 0)
+			die("dup: %s", strerror(errno));
+
+	run_worker_threads(nr_threads, worker, &elapsed);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d threads doing %d %s/close loops, "
+		       "%d descriptors open\n\n", nr_threads, loops,
+		       use_pipe ? "pipe" : "socket", nr_open);
+	/* one descriptor allocated and freed per loop */
+	print_workers_result(&elapsed, nr_threads,
+			     (unsigned long long)loops * nr_threads, "op");
+
+	return 0;
+}
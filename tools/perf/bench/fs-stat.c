@@ -0,0 +1,123 @@
+/*
+ *
+ * fs-stat.c
+ *
+ * stat: Benchmark for path lookup scalability
+ *
+ * Each worker process repeatedly opens, closes and stats files below
+ * one shared directory, so the cost of path walking and of dropping
+ * the last dentry reference can be compared across core counts.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "workers.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define LOOPS_DEFAULT 100000
+#define NR_FILES 16
+
+static int loops = LOOPS_DEFAULT;
+static int nr_procs;
+static const char *dir = "/tmp";
+
+static const struct option options[] = {
+	OPT_INTEGER('p', "procs", &nr_procs,
+		    "Specify number of worker processes (default: online CPUs)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of loops per worker"),
+	OPT_STRING('d', "dir", &dir, "dir",
+		   "Directory to create the test files in"),
+	OPT_END()
+};
+
+static const char * const bench_fs_stat_usage[] = {
+	"perf bench fs stat <options>",
+	NULL
+};
+
+static char base[PATH_MAX];
+static char names[NR_FILES][PATH_MAX];
+
+static void setup_files(void)
+{
+	int i, fd;
+
+	snprintf(base, sizeof(base), "%s/perf-bench-stat.%d", dir, getpid());
+	if (mkdir(base, 0700))
+		die("mkdir %s: %s", base, strerror(errno));
+
+	for (i = 0; i < NR_FILES; i++) {
+		snprintf(names[i], PATH_MAX, "%s/f%d", base, i);
+		fd = open(names[i], O_CREAT | O_RDWR, 0600);
+		if (fd < 0)
+			die("open %s: %s", names[i], strerror(errno));
+		close(fd);
+	}
+}
+
+static void cleanup_files(void)
+{
+	int i;
+
+	for (i = 0; i < NR_FILES; i++)
+		unlink(names[i]);
+	rmdir(base);
+}
+
+static int worker(int id __used)
+{
+	struct stat st;
+	int i, fd;
+
+	for (i = 0; i < loops; i++) {
+		const char *name = names[i % NR_FILES];
+
+		fd = open(name, O_RDONLY);
+		if (fd < 0)
+			return 1;
+		close(fd);
+		if (stat(name, &st))
+			return 1;
+	}
+	return 0;
+}
+
+int bench_fs_stat(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	struct timeval elapsed;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_stat_usage, 0);
+
+	if (nr_procs <= 0)
+		nr_procs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	setup_files();
+	run_worker_procs(nr_procs, worker, &elapsed);
+	cleanup_files();
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d processes doing %d open/close+stat loops each\n\n",
+		       nr_procs, loops);
+	/* one open/close pair plus one stat per loop */
+	print_workers_result(&elapsed, nr_procs,
+			     (unsigned long long)loops * nr_procs * 2, "op");
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Benchmark for futex hash table scalability
+ *
+ * Worker threads each own a set of futexes and call FUTEX_WAIT on them
+ * in turn with a value that does not match, so every call hashes the
+ * futex, takes its hash bucket lock, sees the mismatch and returns
+ * EAGAIN without sleeping.  What is left is the cost of the hash
+ * lookup and of the bucket lock contention between unrelated futexes.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+#include "workers.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#define LOOPS_DEFAULT 10000
+#define FUTEXES_DEFAULT 1024
+
+static int loops = LOOPS_DEFAULT;
+static int nr_futexes = FUTEXES_DEFAULT;
+static int nr_threads;
+static bool fshared;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of worker threads (default: online CPUs)"),
+	OPT_INTEGER('f', "futexes", &nr_futexes,
+		    "Specify number of futexes per thread"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of passes over the futexes per thread"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+static u32 **futexes;
+static int futex_flag;
+
+static int worker(int id)
+{
+	int i, j;
+
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < nr_futexes; j++) {
+			/* the futex is 0: waiting for 1 fails at once */
+			if (futex_wait(&futexes[id][j], 1, futex_flag) != -1 ||
+			    errno != EAGAIN)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval elapsed;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_futexes <= 0)
+		nr_futexes = 1;
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	futexes = calloc(nr_threads, sizeof(*futexes));
+	if (!futexes)
+		die("calloc: %s", strerror(errno));
+	for (i = 0; i < nr_threads; i++) {
+		futexes[i] = calloc(nr_futexes, sizeof(**futexes));
+		if (!futexes[i])
+			die("calloc: %s", strerror(errno));
+	}
+
+	run_worker_threads(nr_threads, worker, &elapsed);
+
+	for (i = 0; i < nr_threads; i++)
+		free(futexes[i]);
+	free(futexes);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d threads each waiting %d times on %d %s futexes\n\n",
+		       nr_threads, loops, nr_futexes,
+		       fshared ? "shared" : "private");
+	print_workers_result(&elapsed, nr_threads,
+			     (unsigned long long)loops * nr_futexes * nr_threads,
+			     "op");
+
+	return 0;
+}
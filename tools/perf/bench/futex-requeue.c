@@ -0,0 +1,154 @@
+/*
+ *
+ * futex-requeue.c
+ *
+ * requeue: Benchmark for requeueing futex waiters
+ *
+ * Worker threads block in FUTEX_WAIT on one futex, and once they all
+ * sleep the main thread moves them to a second futex with
+ * FUTEX_CMP_REQUEUE, a few at a time and waking none, the way a
+ * condition variable broadcast hands its waiters over to the mutex.
+ * Only the requeue calls are timed: each one holds the hash bucket
+ * locks of both futexes.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#define LOOPS_DEFAULT 10
+
+static int loops = LOOPS_DEFAULT;
+static int nr_threads;
+static int nr_requeue = 1;
+static bool fshared;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of waiting threads (default: online CPUs)"),
+	OPT_INTEGER('q', "nrequeue", &nr_requeue,
+		    "Specify number of threads requeued per call"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of times to block and requeue all threads"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_requeue_usage[] = {
+	"perf bench futex requeue <options>",
+	NULL
+};
+
+static u32 futex1, futex2;
+static int futex_flag;
+static int failed;
+
+int bench_futex_requeue(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long requeue_usec = 0, nr_calls = 0;
+	pthread_t *threads;
+	int i, j, requeued, ret;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_requeue_usage, 0);
+
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_requeue <= 0)
+		nr_requeue = 1;
+	if (loops <= 0)
+		loops = 1;
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		die("calloc: %s", strerror(errno));
+
+	for (j = 0; j < loops; j++) {
+		futex_start_waiters(threads, nr_threads, &futex1, futex_flag);
+
+		requeued = 0;
+		gettimeofday(&start, NULL);
+		while (requeued < nr_threads) {
+			/* wakes none, returns how many were requeued */
+			ret = futex_cmp_requeue(&futex1, 0, &futex2, 0,
+						nr_requeue, futex_flag);
+			if (ret < 0) {
+				failed = 1;
+				break;
+			}
+			requeued += ret;
+			nr_calls++;
+			if (!ret)
+				break;
+		}
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+		requeue_usec += diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+		/* everybody is on futex2 now, or gone */
+		while (futex_waiters_returned() < nr_threads) {
+			if (futex_wake(&futex2, nr_threads, futex_flag) < 0 ||
+			    futex_wake(&futex1, nr_threads, futex_flag) < 0) {
+				failed = 1;
+				break;
+			}
+			usleep(1000);
+		}
+		for (i = 0; i < nr_threads; i++)
+			pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	if (failed)
+		fprintf(stderr, "FUTEX_CMP_REQUEUE failed: %s\n",
+			strerror(errno));
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d times requeueing %d threads between %s futexes, "
+		       "%d per call\n\n", loops, nr_threads,
+		       fshared ? "shared" : "private", nr_requeue);
+
+		printf(" %14s: %llu.%03llu [msec]\n\n", "Requeue time",
+		       requeue_usec / loops / 1000,
+		       requeue_usec / loops % 1000);
+
+		printf(" %14lf usecs/call\n",
+		       nr_calls ? (double)requeue_usec / (double)nr_calls : 0);
+		printf(" %14lf usecs/thread requeued\n",
+		       (double)requeue_usec / loops / nr_threads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu.%03llu\n",
+		       requeue_usec / loops / 1000,
+		       requeue_usec / loops % 1000);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
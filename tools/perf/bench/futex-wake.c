@@ -0,0 +1,140 @@
+/*
+ *
+ * futex-wake.c
+ *
+ * wake: Benchmark for futex wakeups of many waiters
+ *
+ * Worker threads block in FUTEX_WAIT on one futex, and once they all
+ * sleep the main thread wakes them with FUTEX_WAKE, a few at a time.
+ * Only the wake calls are timed: they walk the hash bucket the waiters
+ * are queued on under its lock, which is what a condition variable
+ * broadcast or a barrier release costs.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#define LOOPS_DEFAULT 10
+
+static int loops = LOOPS_DEFAULT;
+static int nr_threads;
+static int nr_wake = 1;
+static bool fshared;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of waiting threads (default: online CPUs)"),
+	OPT_INTEGER('w', "nwakes", &nr_wake,
+		    "Specify number of threads woken per FUTEX_WAKE call"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of times to block and wake all threads"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use a shared futex instead of a private one"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static u32 futex;
+static int futex_flag;
+static int failed;
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long wake_usec = 0, nr_calls = 0;
+	pthread_t *threads;
+	int i, j, woken, ret;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_wake_usage, 0);
+
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_wake <= 0)
+		nr_wake = 1;
+	if (loops <= 0)
+		loops = 1;
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		die("calloc: %s", strerror(errno));
+
+	for (j = 0; j < loops; j++) {
+		futex_start_waiters(threads, nr_threads, &futex, futex_flag);
+
+		woken = 0;
+		gettimeofday(&start, NULL);
+		while (woken < nr_threads) {
+			ret = futex_wake(&futex, nr_wake, futex_flag);
+			if (ret < 0) {
+				failed = 1;
+				break;
+			}
+			woken += ret;
+			nr_calls++;
+			/* a waiter that returned on its own is not queued */
+			if (!ret && futex_waiters_returned() == nr_threads)
+				break;
+		}
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+		wake_usec += diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+		for (i = 0; i < nr_threads; i++)
+			pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	if (failed)
+		fprintf(stderr, "FUTEX_WAKE failed: %s\n", strerror(errno));
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d times waking %d threads on a %s futex, "
+		       "%d per call\n\n", loops, nr_threads,
+		       fshared ? "shared" : "private", nr_wake);
+
+		printf(" %14s: %llu.%03llu [msec]\n\n", "Wake time",
+		       wake_usec / loops / 1000, wake_usec / loops % 1000);
+
+		printf(" %14lf usecs/call\n",
+		       nr_calls ? (double)wake_usec / (double)nr_calls : 0);
+		printf(" %14lf usecs/thread woken\n",
+		       (double)wake_usec / loops / nr_threads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu.%03llu\n",
+		       wake_usec / loops / 1000, wake_usec / loops % 1000);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
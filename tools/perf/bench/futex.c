@@ -0,0 +1,52 @@
+/*
+ *
+ * futex.c
+ *
+ * Waiter threads for the futex wake and requeue benchmarks
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "futex.h"
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+static u32 *waiter_uaddr;
+static int waiter_flag;
+static volatile int nr_waiting, nr_returned;
+
+static void *waiter(void *arg __used)
+{
+	__sync_fetch_and_add(&nr_waiting, 1);
+	while (futex_wait(waiter_uaddr, 0, waiter_flag) && errno == EINTR)
+		;
+	__sync_fetch_and_add(&nr_returned, 1);
+	return NULL;
+}
+
+void futex_start_waiters(pthread_t *threads, int nr, u32 *uaddr,
+			 int opflags)
+{
+	int i;
+
+	waiter_uaddr = uaddr;
+	waiter_flag = opflags;
+	nr_waiting = nr_returned = 0;
+	for (i = 0; i < nr; i++)
+		if (pthread_create(&threads[i], NULL, waiter, NULL))
+			die("pthread_create: %s", strerror(errno));
+
+	/* wait for all waiters to get going, then for them to fall asleep */
+	while (nr_waiting < nr)
+		usleep(1000);
+	usleep(100000);
+}
+
+int futex_waiters_returned(void)
+{
+	return nr_returned;
+}
@@ -0,0 +1,48 @@
+/*
+ *
+ * futex.h
+ *
+ * Glibc has no wrappers for futex(2): thin ones for the futex suites,
+ * and the waiter threads the wake and requeue benchmarks block on them
+ *
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/futex.h>
+
+static inline int futex_wait(u32 *uaddr, u32 val, int opflags)
+{
+	return syscall(__NR_futex, uaddr, FUTEX_WAIT | opflags, val,
+		       NULL, NULL, 0);
+}
+
+static inline int futex_wake(u32 *uaddr, int nr_wake, int opflags)
+{
+	return syscall(__NR_futex, uaddr, FUTEX_WAKE | opflags, nr_wake,
+		       NULL, NULL, 0);
+}
+
+/* wake nr_wake waiters of uaddr and move up to nr_requeue to uaddr2 */
+static inline int futex_cmp_requeue(u32 *uaddr, u32 val, u32 *uaddr2,
+				    int nr_wake, int nr_requeue, int opflags)
+{
+	return syscall(__NR_futex, uaddr, FUTEX_CMP_REQUEUE | opflags,
+		       nr_wake, (unsigned long)nr_requeue, uaddr2, val);
+}
+
+/*
+ * Start nr threads waiting on uaddr, which must hold 0, and return once
+ * they have all fallen asleep; futex_waiters_returned() counts those
+ * that have been woken since.
+ */
+extern void futex_start_waiters(pthread_t *threads, int nr, u32 *uaddr,
+				int opflags);
+extern int futex_waiters_returned(void);
+
+#endif /* _FUTEX_H */
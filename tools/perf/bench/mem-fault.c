@@ -0,0 +1,117 @@
+/*
+ *
+ * mem-fault.c
+ *
+ * fault: Benchmark for page fault scalability within one address space
+ *
+ * Worker threads of one process each own a disjoint slice of one
+ * anonymous mapping.  Every loop a worker touches each page of its
+ * slice, taking a fault on each, and then discards the slice again
+ * with MADV_DONTNEED.  Optionally every loop also maps and unmaps a
+ * scratch area, which makes the address space change under the other
+ * workers' faults as in threaded runtimes with their own allocators.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "workers.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#define LOOPS_DEFAULT 100
+#define PAGES_DEFAULT 1024
+
+static int loops = LOOPS_DEFAULT;
+static int nr_pages = PAGES_DEFAULT;
+static int nr_threads;
+static bool do_mmap;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of worker threads (default: online CPUs)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of loops per thread"),
+	OPT_INTEGER('s', "pages", &nr_pages,
+		    "Specify number of pages in each thread's slice"),
+	OPT_BOOLEAN('m', "mmap", &do_mmap,
+		    "Also mmap and munmap a scratch page every loop"),
+	OPT_END()
+};
+
+static const char * const bench_mem_fault_usage[] = {
+	"perf bench mem fault <options>",
+	NULL
+};
+
+static char *area;
+static size_t page_size;
+
+static int worker(int id)
+{
+	size_t len = nr_pages * page_size;
+	char *slice = area + (long)id * len;
+	int i, j;
+
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < nr_pages; j++)
+			slice[j * page_size] = 1;
+		if (madvise(slice, len, MADV_DONTNEED))
+			return 1;
+		if (do_mmap) {
+			void *p = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+				       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+			if (p == MAP_FAILED)
+				return 1;
+			munmap(p, page_size);
+		}
+	}
+	return 0;
+}
+
+int bench_mem_fault(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	struct timeval elapsed;
+	size_t len;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_fault_usage, 0);
+
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_pages <= 0)
+		nr_pages = 1;
+	page_size = sysconf(_SC_PAGESIZE);
+
+	len = (size_t)nr_pages * page_size * nr_threads;
+	area = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		die("mmap: %s", strerror(errno));
+
+	run_worker_threads(nr_threads, worker, &elapsed);
+	munmap(area, len);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d threads faulting %d pages each, %d loops%s\n\n",
+		       nr_threads, nr_pages, loops,
+		       do_mmap ? ", with mmap/munmap" : "");
+	/* one fault per page per loop */
+	print_workers_result(&elapsed, nr_threads,
+			     (unsigned long long)loops * nr_pages * nr_threads,
+			     "fault");
+
+	return 0;
+}
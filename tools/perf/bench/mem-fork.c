@@ -0,0 +1,123 @@
+/*
+ *
+ * mem-fork.c
+ *
+ * fork: Benchmark for fork/exit scalability of processes sharing memory
+ *
+ * The main process populates an anonymous mapping and forks one worker
+ * per CPU, so that all workers share its pages and its anon_vma tree.
+ * Every loop a worker forks a child that writes to a few pages of the
+ * mapping, taking copy-on-write faults, and exits; then the worker
+ * reaps it.  This is the pattern of servers that fork a process per
+ * connection, and it stresses the anon_vma locking of fork and exit.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "workers.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define LOOPS_DEFAULT 1000
+#define SIZE_DEFAULT 64		/* MB */
+#define PAGES_DEFAULT 4
+
+static int loops = LOOPS_DEFAULT;
+static int size_mb = SIZE_DEFAULT;
+static int nr_pages = PAGES_DEFAULT;
+static int nr_workers;
+
+static const struct option options[] = {
+	OPT_INTEGER('w', "workers", &nr_workers,
+		    "Specify number of forking workers (default: online CPUs)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of forks per worker"),
+	OPT_INTEGER('s', "size", &size_mb,
+		    "Specify size of the shared mapping in MB"),
+	OPT_INTEGER('p', "pages", &nr_pages,
+		    "Specify number of pages each child writes to"),
+	OPT_END()
+};
+
+static const char * const bench_mem_fork_usage[] = {
+	"perf bench mem fork <options>",
+	NULL
+};
+
+static char *area;
+static size_t area_len;
+static size_t page_size;
+
+static int worker(int id)
+{
+	size_t nr_area_pages = area_len / page_size;
+	int i, j;
+
+	for (i = 0; i < loops; i++) {
+		pid_t pid = fork();
+		int status;
+
+		if (pid < 0)
+			return 1;
+		if (!pid) {
+			/* spread the children's COW faults over the mapping */
+			for (j = 0; j < nr_pages; j++)
+				area[((size_t)(id + i + j) * 7919 %
+				      nr_area_pages) * page_size] = 1;
+			_exit(0);
+		}
+		if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+			return 1;
+	}
+	return 0;
+}
+
+int bench_mem_fork(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	struct timeval elapsed;
+	size_t i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_fork_usage, 0);
+
+	if (nr_workers <= 0)
+		nr_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (size_mb <= 0)
+		size_mb = 1;
+	if (nr_pages < 0)
+		nr_pages = 0;
+	page_size = sysconf(_SC_PAGESIZE);
+
+	area_len = (size_t)size_mb << 20;
+	area = mmap(NULL, area_len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		die("mmap: %s", strerror(errno));
+	for (i = 0; i < area_len; i += page_size)
+		area[i] = 1;
+
+	run_worker_procs(nr_workers, worker, &elapsed);
+	munmap(area, area_len);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d workers forking %d times each, %d MB shared, "
+		       "%d pages written per child\n\n",
+		       nr_workers, loops, size_mb, nr_pages);
+	print_workers_result(&elapsed, nr_workers,
+			     (unsigned long long)loops * nr_workers, "fork");
+
+	return 0;
+}
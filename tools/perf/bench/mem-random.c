@@ -0,0 +1,148 @@
+/*
+ *
+ * mem-random.c
+ *
+ * random: Benchmark for TLB reach on a large anonymous buffer
+ *
+ * The buffer is populated by touching every page once, then read at
+ * random offsets.  Each read depends on the previous one, so the time
+ * per read is the memory latency plus the TLB miss cost, which is what
+ * transparent huge pages cut.  Optionally the buffer is marked with
+ * madvise(MADV_HUGEPAGE) first.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+
+#define SIZE_DEFAULT 1024	/* MB */
+#define READS_DEFAULT (16 * 1024 * 1024)
+#define ALIGN_HUGE (2UL << 20)
+
+static int size_mb = SIZE_DEFAULT;
+static int nr_reads = READS_DEFAULT;
+static bool hugepage;
+
+static const struct option options[] = {
+	OPT_INTEGER('s', "size", &size_mb,
+		    "Specify size of the buffer in MB"),
+	OPT_INTEGER('r', "reads", &nr_reads,
+		    "Specify number of random reads"),
+	OPT_BOOLEAN('H', "hugepage", &hugepage,
+		    "Mark the buffer with madvise(MADV_HUGEPAGE)"),
+	OPT_END()
+};
+
+static const char * const bench_mem_random_usage[] = {
+	"perf bench mem random <options>",
+	NULL
+};
+
+static unsigned long long tv_usec(struct timeval *tv)
+{
+	return tv->tv_sec * 1000000ULL + tv->tv_usec;
+}
+
+int bench_mem_random(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, populated, stop, diff;
+	unsigned long long populate_usec, read_usec;
+	size_t len, page_size, nr_words, i;
+	uint64_t *buf, x, sum = 0;
+	char *area;
+	int j;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_random_usage, 0);
+
+	if (size_mb <= 0)
+		size_mb = 1;
+	if (nr_reads <= 0)
+		nr_reads = 1;
+	page_size = sysconf(_SC_PAGESIZE);
+	len = (size_t)size_mb << 20;
+
+	/* over-allocate so that the buffer can start on a 2M boundary */
+	area = mmap(NULL, len + ALIGN_HUGE, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		die("mmap: %s", strerror(errno));
+	buf = (uint64_t *)(((unsigned long)area + ALIGN_HUGE - 1) &
+			   ~(ALIGN_HUGE - 1));
+	if (hugepage && madvise(buf, len, MADV_HUGEPAGE))
+		fprintf(stderr, "madvise(MADV_HUGEPAGE): %s\n",
+			strerror(errno));
+	nr_words = len / sizeof(*buf);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_words; i += page_size / sizeof(*buf))
+		buf[i] = 0;
+	gettimeofday(&populated, NULL);
+
+	/* xorshift; the word read feeds the next index */
+	x = 88172645463325252ULL;
+	for (j = 0; j < nr_reads; j++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		x += buf[x % nr_words];
+		sum += x;
+	}
+	gettimeofday(&stop, NULL);
+	munmap(area, len + ALIGN_HUGE);
+
+	timersub(&populated, &start, &diff);
+	populate_usec = tv_usec(&diff);
+	timersub(&stop, &populated, &diff);
+	read_usec = tv_usec(&diff);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d MB buffer%s, %d random reads (checksum %llx)\n\n",
+		       size_mb, hugepage ? " with MADV_HUGEPAGE" : "",
+		       nr_reads, (unsigned long long)(sum & 0xfff));
+
+		printf(" %14s: %llu.%03llu [sec]\n", "Populate",
+		       populate_usec / 1000000, populate_usec / 1000 % 1000);
+		printf(" %14s: %llu.%03llu [sec]\n\n", "Random reads",
+		       read_usec / 1000000, read_usec / 1000 % 1000);
+
+		printf(" %14lf nsecs/read\n",
+		       (double)read_usec * 1000 / (double)nr_reads);
+		printf(" %14lf MB/sec populated\n",
+		       populate_usec ?
+		       (double)size_mb * 1000000 / (double)populate_usec : 0);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu.%03llu\n",
+		       read_usec / 1000000, read_usec / 1000 % 1000);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
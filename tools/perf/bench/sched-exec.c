@@ -0,0 +1,100 @@
+/*
+ *
+ * sched-exec.c
+ *
+ * exec: Benchmark for exec of the same program
+ *
+ * Worker processes, one per CPU by default, each vfork a child that
+ * execs the given program and reap it, over and over.  The program is
+ * meant to do next to nothing, so what is measured is exec itself:
+ * opening and reading the binary and its interpreter, setting up the
+ * new address space and tearing it down again, as for a build running
+ * the same shell or compiler driver over and over.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "workers.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define LOOPS_DEFAULT 1000
+
+static int loops = LOOPS_DEFAULT;
+static int nr_workers;
+static const char *program = "/bin/true";
+
+static const struct option options[] = {
+	OPT_INTEGER('w', "workers", &nr_workers,
+		    "Specify number of exec'ing workers (default: online CPUs)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of execs per worker"),
+	OPT_STRING('e', "exec", &program, "path",
+		   "Specify program to exec (default: /bin/true)"),
+	OPT_END()
+};
+
+static const char * const bench_sched_exec_usage[] = {
+	"perf bench sched exec <options>",
+	NULL
+};
+
+extern char **environ;
+
+static int worker(int id __used)
+{
+	char *argv[] = { (char *)program, NULL };
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		pid_t pid = vfork();
+		int status;
+
+		if (pid < 0)
+			return 1;
+		if (!pid) {
+			execve(program, argv, environ);
+			_exit(127);
+		}
+		if (waitpid(pid, &status, 0) != pid ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			return 1;
+	}
+	return 0;
+}
+
+int bench_sched_exec(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval elapsed;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_exec_usage, 0);
+
+	if (nr_workers <= 0)
+		nr_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (loops <= 0)
+		loops = 1;
+
+	if (run_worker_procs(nr_workers, worker, &elapsed))
+		fprintf(stderr, "could not run %s\n", program);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d workers exec'ing %s %d times each\n\n",
+		       nr_workers, program, loops);
+	print_workers_result(&elapsed, nr_workers,
+			     (unsigned long long)loops * nr_workers, "exec");
+
+	return 0;
+}
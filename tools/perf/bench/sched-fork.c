@@ -0,0 +1,88 @@
+/*
+ *
+ * sched-fork.c
+ *
+ * fork: Benchmark for process creation and exit
+ *
+ * Worker processes, one per CPU by default, each fork a child that
+ * exits at once and reap it, over and over.  The workers are small, so
+ * what is measured is mostly the part of fork, exit and wait that does
+ * not depend on the address space: pid allocation and hashing, task
+ * list linking and reaping, as for a server forking a short lived
+ * process per request.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "workers.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define LOOPS_DEFAULT 10000
+
+static int loops = LOOPS_DEFAULT;
+static int nr_workers;
+
+static const struct option options[] = {
+	OPT_INTEGER('w', "workers", &nr_workers,
+		    "Specify number of forking workers (default: online CPUs)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of forks per worker"),
+	OPT_END()
+};
+
+static const char * const bench_sched_fork_usage[] = {
+	"perf bench sched fork <options>",
+	NULL
+};
+
+static int worker(int id __used)
+{
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		pid_t pid = fork();
+		int status;
+
+		if (pid < 0)
+			return 1;
+		if (!pid)
+			_exit(0);
+		if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+			return 1;
+	}
+	return 0;
+}
+
+int bench_sched_fork(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval elapsed;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_fork_usage, 0);
+
+	if (nr_workers <= 0)
+		nr_workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	run_worker_procs(nr_workers, worker, &elapsed);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d workers forking %d times each\n\n",
+		       nr_workers, loops);
+	print_workers_result(&elapsed, nr_workers,
+			     (unsigned long long)loops * nr_workers, "fork");
+
+	return 0;
+}
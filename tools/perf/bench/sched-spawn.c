@@ -0,0 +1,193 @@
+/*
+ *
+ * sched-spawn.c
+ *
+ * spawn: Benchmark for starting a program from a large process
+ *
+ * Populates an anonymous mapping of the given size, then starts a
+ * program and waits for it, over and over, in each of three ways:
+ * fork() and execve(), vfork() and execve(), and the spawn() system
+ * call, which execs in a new process without copying the caller's
+ * address space.  fork() has to copy the page tables of the mapping,
+ * so its cost grows with the size of the parent; the other two do not.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define LOOPS_DEFAULT 1000
+
+static int loops = LOOPS_DEFAULT;
+static int size_mb;
+static const char *program = "/bin/true";
+static const char *mode = "all";
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of programs to start"),
+	OPT_INTEGER('s', "size", &size_mb,
+		    "Specify size of the parent's populated mapping in MB"),
+	OPT_STRING('e', "exec", &program, "path",
+		   "Specify program to start (default: /bin/true)"),
+	OPT_STRING('m', "mode", &mode, "mode",
+		   "Specify fork, vfork, spawn or all (default: all)"),
+	OPT_END()
+};
+
+static const char * const bench_sched_spawn_usage[] = {
+	"perf bench sched spawn <options>",
+	NULL
+};
+
+extern char **environ;
+
+static pid_t start_fork(char *const argv[])
+{
+	pid_t pid = fork();
+
+	if (!pid) {
+		execve(program, argv, environ);
+		_exit(127);
+	}
+	return pid;
+}
+
+static pid_t start_vfork(char *const argv[])
+{
+	pid_t pid = vfork();
+
+	if (!pid) {
+		execve(program, argv, environ);
+		_exit(127);
+	}
+	return pid;
+}
+
+static pid_t start_spawn(char *const argv[] __used)
+{
+#ifdef __NR_spawn
+	/* no file actions, no flags */
+	return syscall(__NR_spawn, program, argv, environ, NULL, 0, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+struct spawn_mode {
+	const char *name;
+	pid_t (*start)(char *const argv[]);
+};
+
+static struct spawn_mode modes[] = {
+	{ "fork",	start_fork  },
+	{ "vfork",	start_vfork },
+	{ "spawn",	start_spawn },
+	{ NULL,		NULL        }
+};
+
+static void run_mode(struct spawn_mode *m)
+{
+	char *argv[] = { (char *)program, NULL };
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	int i, status;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < loops; i++) {
+		pid_t pid = m->start(argv);
+
+		if (pid < 0) {
+			fprintf(stderr, "%s: %s\n", m->name, strerror(errno));
+			return;
+		}
+		if (waitpid(pid, &status, 0) != pid ||
+		    !WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "%s: %s failed\n", m->name, program);
+			return;
+		}
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %14s: %lu.%03lu [sec] %14lf usecs/program\n",
+		       m->name, diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000),
+		       (double)result_usec / (double)loops);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%s %lu.%03lu\n", m->name,
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+}
+
+int bench_sched_spawn(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	struct spawn_mode *m;
+	size_t len, page_size, i;
+	char *area = NULL;
+	int found = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_spawn_usage, 0);
+
+	if (loops <= 0)
+		loops = 1;
+	if (size_mb < 0)
+		size_mb = 0;
+	page_size = sysconf(_SC_PAGESIZE);
+	len = (size_t)size_mb << 20;
+
+	if (len) {
+		area = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (area == MAP_FAILED)
+			die("mmap: %s", strerror(errno));
+		for (i = 0; i < len; i += page_size)
+			area[i] = 1;
+	}
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# starting %s %d times from a %d MB process\n\n",
+		       program, loops, size_mb);
+
+	for (m = modes; m->name; m++) {
+		if (strcmp(mode, "all") && strcmp(mode, m->name))
+			continue;
+		found = 1;
+		run_mode(m);
+	}
+	if (!found)
+		fprintf(stderr, "Unknown mode:%s\n", mode);
+
+	if (area)
+		munmap(area, len);
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ *
+ * workers.c
+ *
+ * Start a set of workers together and time them
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "bench.h"
+#include "workers.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static int start_pipe[2];
+
+/* wait until the main process releases everybody at once */
+static int wait_for_start(void)
+{
+	char c;
+
+	return read(start_pipe[0], &c, 1) < 0;
+}
+
+static void release_workers(struct timeval *start)
+{
+	gettimeofday(start, NULL);
+	/* closing the write end wakes every worker with EOF */
+	close(start_pipe[1]);
+}
+
+static void stop_clock(const struct timeval *start, struct timeval *elapsed)
+{
+	struct timeval stop;
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, start, elapsed);
+	close(start_pipe[0]);
+}
+
+int run_worker_procs(int nr, worker_fn_t fn, struct timeval *elapsed)
+{
+	struct timeval start;
+	pid_t *pids;
+	int i, status, failed = 0;
+
+	pids = calloc(nr, sizeof(*pids));
+	if (!pids)
+		die("calloc: %s", strerror(errno));
+	if (pipe(start_pipe))
+		die("pipe: %s", strerror(errno));
+
+	/* or the workers print it again when they exit */
+	fflush(stdout);
+	for (i = 0; i < nr; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0)
+			die("fork: %s", strerror(errno));
+		if (!pids[i]) {
+			close(start_pipe[1]);
+			exit(wait_for_start() || fn(i));
+		}
+	}
+
+	release_workers(&start);
+	for (i = 0; i < nr; i++) {
+		if (waitpid(pids[i], &status, 0) != pids[i] ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			failed = 1;
+	}
+	stop_clock(&start, elapsed);
+	free(pids);
+
+	if (failed)
+		fprintf(stderr, "worker failed\n");
+	return failed;
+}
+
+struct worker_thread {
+	pthread_t	thread;
+	worker_fn_t	fn;
+	int		id;
+	int		ret;
+};
+
+static void *worker_thread(void *arg)
+{
+	struct worker_thread *w = arg;
+
+	w->ret = wait_for_start() || w->fn(w->id);
+	return NULL;
+}
+
+int run_worker_threads(int nr, worker_fn_t fn, struct timeval *elapsed)
+{
+	struct worker_thread *workers;
+	struct timeval start;
+	int i, failed = 0;
+
+	workers = calloc(nr, sizeof(*workers));
+	if (!workers)
+		die("calloc: %s", strerror(errno));
+	if (pipe(start_pipe))
+		die("pipe: %s", strerror(errno));
+
+	for (i = 0; i < nr; i++) {
+		workers[i].fn = fn;
+		workers[i].id = i;
+		if (pthread_create(&workers[i].thread, NULL,
+				   worker_thread, &workers[i]))
+			die("pthread_create: %s", strerror(errno));
+	}
+
+	release_workers(&start);
+	for (i = 0; i < nr; i++) {
+		pthread_join(workers[i].thread, NULL);
+		failed |= workers[i].ret;
+	}
+	stop_clock(&start, elapsed);
+	free(workers);
+
+	if (failed)
+		fprintf(stderr, "worker failed\n");
+	return failed;
+}
+
+void print_workers_result(const struct timeval *elapsed, int nr_workers,
+			  unsigned long long nr_ops, const char *op)
+{
+	unsigned long long result_usec;
+
+	result_usec = elapsed->tv_sec * 1000000ULL + elapsed->tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       elapsed->tv_sec,
+		       (unsigned long) (elapsed->tv_usec/1000));
+
+		printf(" %14lf usecs/%s\n",
+		       nr_ops ? (double)result_usec * nr_workers /
+				(double)nr_ops : 0, op);
+		printf(" %14llu %ss/sec\n",
+		       result_usec ? nr_ops * 1000000ULL / result_usec : 0,
+		       op);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       elapsed->tv_sec,
+		       (unsigned long) (elapsed->tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+}
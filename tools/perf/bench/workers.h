@@ -0,0 +1,36 @@
+/*
+ *
+ * workers.h
+ *
+ * Start a set of workers together and time them: shared by the
+ * scalability benchmarks, which only supply the per-worker loop
+ *
+ */
+
+#ifndef _WORKERS_H
+#define _WORKERS_H
+
+#include <sys/time.h>
+
+/* the per-worker loop: returns nonzero if the worker failed */
+typedef int (*worker_fn_t)(int id);
+
+/*
+ * Run fn(0) .. fn(nr - 1) in nr forked processes, or in nr threads,
+ * released at once after all of them exist.  The time from the release
+ * until the last one finished goes to *elapsed.  Returns nonzero, after
+ * saying so, if any worker failed.
+ */
+extern int run_worker_procs(int nr, worker_fn_t fn, struct timeval *elapsed);
+extern int run_worker_threads(int nr, worker_fn_t fn, struct timeval *elapsed);
+
+/*
+ * Print elapsed in the current bench_format; in the default one also
+ * the cost of each of the nr_ops ops (named op) as seen by one of the
+ * nr_workers workers, and the aggregate rate.
+ */
+extern void print_workers_result(const struct timeval *elapsed,
+				 int nr_workers, unsigned long long nr_ops,
+				 const char *op);
+
+#endif /* _WORKERS_H */
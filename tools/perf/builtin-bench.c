@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  fs    ... filesystem and VFS scalability
+ *  futex ... futex hash table and wakeup scalability
  *
  */
 
@@ -42,6 +44,15 @@ static struct bench_suite sched_suites[] = {
 	{ "pipe",
 	  "Flood of communication over pipe() between two processes",
 	  bench_sched_pipe      },
+	{ "fork",
+	  "Parallel fork/exit/wait of small processes",
+	  bench_sched_fork      },
+	{ "spawn",
+	  "Starting a program with fork, vfork and spawn from a large process",
+	  bench_sched_spawn     },
+	{ "exec",
+	  "Parallel exec of the same small program",
+	  bench_sched_exec      },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -52,6 +63,47 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "fault",
+	  "Parallel page faults in disjoint parts of one address space",
+	  bench_mem_fault },
+	{ "random",
+	  "Random reads over a large buffer, optionally with huge pages",
+	  bench_mem_random },
+	{ "fork",
+	  "Parallel fork/exit of processes sharing anonymous memory",
+	  bench_mem_fork },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite fs_suites[] = {
+	{ "stat",
+	  "Parallel open/close and stat of files in one directory",
+	  bench_fs_stat },
+	{ "create",
+	  "Parallel create/write/unlink of files in one directory",
+	  bench_fs_create },
+	{ "fdalloc",
+	  "Parallel socket/close in threads sharing one fd table",
+	  bench_fs_fdalloc },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "Parallel FUTEX_WAIT calls on many futexes that fail at once",
+	  bench_futex_hash },
+	{ "wake",
+	  "FUTEX_WAKE of many threads blocked on one futex",
+	  bench_futex_wake },
+	{ "requeue",
+	  "FUTEX_CMP_REQUEUE of many threads from one futex to another",
+	  bench_futex_requeue },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -71,6 +123,12 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "fs",
+	  "filesystem and VFS scalability",
+	  fs_suites },
+	{ "futex",
+	  "futex hash table and wakeup scalability",
+	  futex_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },